@@ -0,0 +1,994 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "structures.h"
+
+// Benchmark of queue operations
+// Results are printed to stderr, run with stdout redirected: ./bench > /dev/null
+// Build with -DPUBSUB_MALLOC_NODES to compare against malloc/free per message
+// Build with -DPUBSUB_PACKED_LAYOUT to compare against queue without cache line aligned sections
+// Build with -DBENCH_WRAP_LOCK -Wl,--wrap=pthread_mutex_lock to measure time spent waiting for queue mutex
+//
+// Usage: ./bench [-c micro|fanout|fanin|churn] [-p publishers] [-s subscribers] [-m msgMax]
+//                [-l payload bytes] [-b batch] [-d seconds] [-u churn interval] [-e list|ring]
+//                [-w park|spin|yield|spinpark] [-o block|oldest|newest|evict] [-r receivers|cursor|hazard]
+
+
+// -= Interfaces =-
+void createQueueI(TQueue *queue, int size);
+bool createQueueConfigI(TQueue *queue, int size, const TQueueConfig *config);
+void destroyQueueI(TQueue *queue);
+TSubscriberHandle subscribeI(TQueue *queue, pthread_t thread);
+void unsubscribeI(TQueue *queue, pthread_t thread);
+int putI(TQueue *queue, void *msg);
+int putBatchI(TQueue *queue, void **msgs, int n);
+int putHandleI(TQueue *queue, void *msg, TMessageHandle *handle);
+void removeI(TQueue *queue, void *msg);
+int removeByHandleI(TQueue *queue, TMessageHandle handle);
+bool setOverflowPolicyI(TQueue *queue, QueueOverflowPolicy policy);
+TOverflowStats getOverflowStatsI(TQueue *queue);
+void getQueueStatsI(TQueue *queue, TQueueStats *stats);
+bool setMaxLagI(TQueue *queue, int maxLag, uint64_t maxLagNs);
+bool getLatencyHistogramI(TQueue *queue, TSubscriberHandle handle, TLatencyHistogram *histogram);
+uint64_t latencyPercentileI(const TLatencyHistogram *histogram, double percentile);
+void dumpLockProfileI(TQueue *queue, FILE *out);
+int putCopyI(TQueue *queue, const void *buf, int len);
+int getCopyI(TQueue *queue, TSubscriberHandle handle, void *buf, int capacity);
+void initPayloadI(TPayload *payload, void *data, int length, void (*release)(TPayload *payload), void *context);
+void releasePayloadI(TPayload *payload);
+int putPayloadI(TQueue *queue, TPayload *payload);
+TPutSlot reservePutI(TQueue *queue, int len);
+int commitPutI(TQueue *queue, TPutSlot slot);
+void *getI(TQueue *queue, pthread_t thread);
+void *getByHandleI(TQueue *queue, TSubscriberHandle handle);
+int getBatchI(TQueue *queue, TSubscriberHandle handle, void **out, int max);
+int getBatchWaitI(TQueue *queue, TSubscriberHandle handle, void **out, int max, int minCount, const struct timespec *deadline);
+void unsubscribeByHandleI(TQueue *queue, TSubscriberHandle handle);
+bool createBrokerI(TBroker *broker, int maxTopics, int topicSize, const TQueueConfig *config);
+void destroyBrokerI(TBroker *broker);
+TQueue *findTopicI(TBroker *broker, const char *name);
+TQueue *createTopicI(TBroker *broker, const char *name);
+int publishToTopicI(TBroker *broker, const char *name, void *msg);
+
+// -= Supportive functions =-
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct timespec deadlineIn(uint64_t ns) {
+    uint64_t at = nowNs() + ns;
+    struct timespec ts = { at / 1000000000ull, at % 1000000000ull };
+    return ts;
+}
+
+static long contextSwitches() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+
+// -= Perf counters =-
+// Counts hardware event of calling thread and of threads created later (added when they exit)
+// Returns -1 if counters are not available (no PMU, perf_event_paranoid)
+static int perfOpen(uint64_t event) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = event;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t perfRead(int fd) {
+    uint64_t count = 0;
+    if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))
+        return 0;
+    return count;
+}
+
+
+// -= Lock wait =-
+// Uncontended lock is taken by trylock, only contended acquisitions are timed
+typedef struct {
+    uint64_t waitNs;
+    uint64_t contended;
+    uint64_t acquired;
+} LockWait;
+
+static __thread LockWait threadLockWait;
+static LockWait lockWait;
+static pthread_mutex_t lockWaitMutex = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef BENCH_WRAP_LOCK
+int __real_pthread_mutex_lock(pthread_mutex_t *mutex);
+
+int __wrap_pthread_mutex_lock(pthread_mutex_t *mutex) {
+    threadLockWait.acquired++;
+    if (pthread_mutex_trylock(mutex) == 0)
+        return 0;
+
+    uint64_t start = nowNs();
+    int result = __real_pthread_mutex_lock(mutex);
+    threadLockWait.waitNs += nowNs() - start;
+    threadLockWait.contended++;
+    return result;
+}
+#endif
+
+// Adds lock wait of calling thread to totals, called by workers before they exit
+static void lockWaitCollect() {
+    pthread_mutex_lock(&lockWaitMutex);
+    lockWait.waitNs += threadLockWait.waitNs;
+    lockWait.contended += threadLockWait.contended;
+    lockWait.acquired += threadLockWait.acquired;
+    pthread_mutex_unlock(&lockWaitMutex);
+    memset(&threadLockWait, 0, sizeof(LockWait));
+}
+
+
+// -= Latency histogram =-
+// Log-linear buckets (HDR style), every power of two is split into 2^HIST_SUB_BITS buckets,
+// so recorded value is within ~3% of real one
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} Histogram;
+
+static int histIndex(uint64_t value) {
+    if (value < HIST_SUB_COUNT)
+        return (int)value;
+
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + (int)((value >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+// Lowest value of bucket
+static uint64_t histValue(int index) {
+    if (index < HIST_SUB_COUNT)
+        return index;
+
+    int shift = (index >> HIST_SUB_BITS) - 1;
+    return (uint64_t)(HIST_SUB_COUNT + (index & (HIST_SUB_COUNT - 1))) << shift;
+}
+
+static void histRecord(Histogram *hist, uint64_t value) {
+    hist->counts[histIndex(value)]++;
+    hist->total++;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+static void histMerge(Histogram *into, const Histogram *from) {
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        into->counts[i] += from->counts[i];
+    into->total += from->total;
+    if (from->max > into->max)
+        into->max = from->max;
+}
+
+static uint64_t histPercentile(const Histogram *hist, double percentile) {
+    uint64_t target = (uint64_t)(hist->total * percentile / 100.0);
+    if (target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= target)
+            return histValue(i);
+    }
+    return hist->max;
+}
+
+
+// -= Micro cases =-
+// Single thread puts and gets, without contention call time is lock hold time plus lock/unlock
+static void benchHoldTime(int msgMax, int rounds) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    createQueueI(queue, msgMax);
+    subscribeI(queue, pthread_self());
+
+    uint64_t putNs = 0, getNs = 0;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t start = nowNs();
+        for (int i = 0; i < msgMax; i++)
+            putI(queue, queue);
+        uint64_t middle = nowNs();
+        for (int i = 0; i < msgMax; i++)
+            getI(queue, pthread_self());
+        uint64_t end = nowNs();
+
+        putNs += middle - start;
+        getNs += end - middle;
+    }
+
+    long ops = (long)msgMax * rounds;
+    fprintf(stderr, "hold time | msgMax %d | put %.1f ns/op | get %.1f ns/op\n",
+        msgMax, (double)putNs / ops, (double)getNs / ops);
+
+    unsubscribeI(queue, pthread_self());
+    destroyQueueI(queue);
+}
+
+// Same as hold time, but payload is copied into queue (inline or pooled buffer) and out of it
+static void benchCopy(int msgMax, int rounds, int length) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    createQueueI(queue, msgMax);
+    TSubscriberHandle handle = subscribeI(queue, pthread_self());
+    char *payload = calloc(1, length);
+    char *out = malloc(length);
+
+    uint64_t putNs = 0, getNs = 0;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t start = nowNs();
+        for (int i = 0; i < msgMax; i++)
+            putCopyI(queue, payload, length);
+        uint64_t middle = nowNs();
+        for (int i = 0; i < msgMax; i++)
+            getCopyI(queue, handle, out, length);
+        uint64_t end = nowNs();
+
+        putNs += middle - start;
+        getNs += end - middle;
+    }
+
+    long ops = (long)msgMax * rounds;
+    fprintf(stderr, "copy      | %d bytes | put %.1f ns/op | get %.1f ns/op\n",
+        length, (double)putNs / ops, (double)getNs / ops);
+
+    free(payload);
+    free(out);
+    unsubscribeByHandleI(queue, handle);
+    destroyQueueI(queue);
+}
+
+// Payload is written straight into queue owned storage, compare with copy case of same size
+static void benchReserve(int msgMax, int rounds, int length) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    createQueueI(queue, msgMax);
+    TSubscriberHandle handle = subscribeI(queue, pthread_self());
+    char *out = malloc(length);
+
+    uint64_t putNs = 0, getNs = 0;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t start = nowNs();
+        for (int i = 0; i < msgMax; i++) {
+            TPutSlot slot = reservePutI(queue, length);
+            memset(slot.data, i, length);
+            commitPutI(queue, slot);
+        }
+        uint64_t middle = nowNs();
+        for (int i = 0; i < msgMax; i++)
+            getCopyI(queue, handle, out, length);
+        uint64_t end = nowNs();
+
+        putNs += middle - start;
+        getNs += end - middle;
+    }
+
+    long ops = (long)msgMax * rounds;
+    fprintf(stderr, "reserve   | %d bytes | reserve+commit %.1f ns/op | get %.1f ns/op\n",
+        length, (double)putNs / ops, (double)getNs / ops);
+
+    free(out);
+    unsubscribeByHandleI(queue, handle);
+    destroyQueueI(queue);
+}
+
+// Publisher-side pool of payloads, release callback returns payload to it
+typedef struct {
+    TPayload *free;
+} PayloadPool;
+
+static void payloadRecycle(TPayload *payload) {
+    PayloadPool *pool = payload->context;
+    payload->nextReleased = pool->free;
+    pool->free = payload;
+}
+
+// Same as copy, but payload is handed over by reference and recycled once subscriber released it
+static void benchPayload(int msgMax, int rounds, int length) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    createQueueI(queue, msgMax);
+    TSubscriberHandle handle = subscribeI(queue, pthread_self());
+
+    PayloadPool pool = { NULL };
+    TPayload *payloads = calloc(msgMax, sizeof(TPayload));
+    char *data = calloc(msgMax, length);
+    for (int i = 0; i < msgMax; i++) {
+        payloads[i].context = &pool;
+        payloads[i].data = data + (size_t)i * length;
+        payloadRecycle(&payloads[i]);
+    }
+
+    uint64_t putNs = 0, getNs = 0;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t start = nowNs();
+        for (int i = 0; i < msgMax; i++) {
+            TPayload *payload = pool.free;
+            pool.free = payload->nextReleased;
+            initPayloadI(payload, payload->data, length, payloadRecycle, &pool);
+            putPayloadI(queue, payload);
+            releasePayloadI(payload);
+        }
+        uint64_t middle = nowNs();
+        for (int i = 0; i < msgMax; i++)
+            releasePayloadI(getByHandleI(queue, handle));
+        uint64_t end = nowNs();
+
+        putNs += middle - start;
+        getNs += end - middle;
+    }
+
+    long ops = (long)msgMax * rounds;
+    fprintf(stderr, "payload   | %d bytes | put %.1f ns/op | get %.1f ns/op\n",
+        length, (double)putNs / ops, (double)getNs / ops);
+
+    unsubscribeByHandleI(queue, handle);
+    destroyQueueI(queue);
+    free(payloads);
+    free(data);
+}
+
+// Reader walks through messages kept alive by lagging second subscriber,
+// per-get cost should not depend on queue depth
+static void benchDepth(int depth) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    createQueueI(queue, depth);
+    TSubscriberHandle reader = subscribeI(queue, pthread_self());
+    TSubscriberHandle lagging = subscribeI(queue, pthread_self());
+
+    for (int i = 0; i < depth; i++)
+        putI(queue, queue);
+
+    uint64_t start = nowNs();
+    for (int i = 0; i < depth; i++)
+        getByHandleI(queue, reader);
+    uint64_t elapsed = nowNs() - start;
+
+    fprintf(stderr, "depth     | msgMax %d | get %.1f ns/op\n", depth, (double)elapsed / depth);
+
+    unsubscribeByHandleI(queue, lagging);
+    unsubscribeByHandleI(queue, reader);
+    destroyQueueI(queue);
+}
+
+// Cancels newest messages first, removeI walks from head for each of them, handle removal does not depend on depth
+static void benchRemove(int depth) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    createQueueI(queue, depth);
+    TSubscriberHandle reader = subscribeI(queue, pthread_self());
+    TMessageHandle *handles = malloc(sizeof(TMessageHandle) * depth);
+    char *msgs = malloc(depth);
+
+    for (int i = 0; i < depth; i++)
+        putHandleI(queue, &msgs[i], &handles[i]);
+
+    uint64_t start = nowNs();
+    for (int i = depth - 1; i >= 0; i -= 2)
+        removeByHandleI(queue, handles[i]);
+    uint64_t middle = nowNs();
+    for (int i = depth - 2; i >= 0; i -= 2)
+        removeI(queue, &msgs[i]);
+    uint64_t end = nowNs();
+
+    int half = depth / 2;
+    fprintf(stderr, "remove    | depth %d | by handle %.1f ns/op | by pointer %.1f ns/op\n",
+        depth, (double)(middle - start) / half, (double)(end - middle) / half);
+
+    unsubscribeByHandleI(queue, reader);
+    destroyQueueI(queue);
+    free(msgs);
+    free(handles);
+}
+
+// Publisher keeps putting into queue full because of stuck subscriber, put must not block
+static void benchOverflow(int msgMax, int messages, QueueOverflowPolicy policy) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    createQueueI(queue, msgMax);
+    setOverflowPolicyI(queue, policy);
+    TSubscriberHandle stuck = subscribeI(queue, pthread_self());
+
+    uint64_t start = nowNs();
+    for (int i = 0; i < messages; i++)
+        putI(queue, queue);
+    uint64_t elapsed = nowNs() - start;
+
+    TOverflowStats overflow = getOverflowStatsI(queue);
+    fprintf(stderr, "overflow  | %s | put %.1f ns/op | %llu dropped\n",
+        policy == OVERFLOW_DROP_OLDEST ? "drop oldest" : "drop newest", (double)elapsed / messages,
+        (unsigned long long)(overflow.droppedOldest + overflow.droppedNewest));
+
+    unsubscribeByHandleI(queue, stuck);
+    destroyQueueI(queue);
+}
+
+// Dead subscribers hold maxLag messages, compares bulk lag out by put with unsubscribing them one by one
+static void benchLag(int dead, int maxLag) {
+    uint64_t elapsed[2];
+    for (int bulk = 0; bulk < 2; bulk++) {
+        TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+        createQueueI(queue, maxLag + 2);
+        TSubscriberHandle reader = subscribeI(queue, pthread_self());
+        TSubscriberHandle *handles = malloc(sizeof(TSubscriberHandle) * dead);
+        for (int i = 0; i < dead; i++)
+            handles[i] = subscribeI(queue, pthread_self());
+        for (int i = 0; i < maxLag; i++) {
+            putI(queue, queue);
+            getByHandleI(queue, reader);
+        }
+
+        uint64_t start = nowNs();
+        if (bulk) {
+            setMaxLagI(queue, maxLag, 0);
+            putI(queue, queue);
+            putI(queue, queue);
+        } else {
+            for (int i = 0; i < dead; i++)
+                unsubscribeByHandleI(queue, handles[i]);
+        }
+        elapsed[bulk] = nowNs() - start;
+
+        free(handles);
+        destroyQueueI(queue);
+    }
+
+    fprintf(stderr, "lag       | %d dead, %d messages | unsubscribe each %.1f us | lag out %.1f us\n",
+        dead, maxLag, elapsed[0] / 1e3, elapsed[1] / 1e3);
+}
+
+// Many subscribers which are behind the tail, put should not visit them
+static void benchSubscribers(int subscribers, int messages) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    createQueueI(queue, messages + 1);
+    for (int i = 0; i < subscribers; i++)
+        subscribeI(queue, pthread_self());
+    putI(queue, queue);
+
+    uint64_t start = nowNs();
+    for (int i = 0; i < messages; i++)
+        putI(queue, queue);
+    uint64_t elapsed = nowNs() - start;
+
+    fprintf(stderr, "subscribers | %d lagging | put %.1f ns/op\n", subscribers, (double)elapsed / messages);
+    destroyQueueI(queue);
+}
+
+// Lock-free topic lookup, cost should not depend on number of topics
+static void benchTopics(int topics, int rounds) {
+    TBroker *broker = aligned_alloc(CACHE_LINE, sizeof(TBroker));
+    createBrokerI(broker, topics, 64, NULL);
+
+    char (*names)[TOPIC_NAME_SIZE] = malloc((size_t)topics * TOPIC_NAME_SIZE);
+    for (int i = 0; i < topics; i++) {
+        snprintf(names[i], TOPIC_NAME_SIZE, "bench/topic/%d", i);
+        createTopicI(broker, names[i]);
+    }
+
+    uint64_t start = nowNs();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < topics; i++)
+            findTopicI(broker, names[i]);
+    uint64_t middle = nowNs();
+    // Topics have no subscribers, put drops the message right away
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < topics; i++)
+            publishToTopicI(broker, names[i], broker);
+    uint64_t end = nowNs();
+
+    long ops = (long)topics * rounds;
+    fprintf(stderr, "topics    | %d topics | lookup %.1f ns/op | publish %.1f ns/op\n",
+        topics, (double)(middle - start) / ops, (double)(end - middle) / ops);
+
+    free(names);
+    destroyBrokerI(broker);
+}
+
+// Two threads update hot producer (tailSeq) and consumer (msgNumber) fields of one queue, like put and get do.
+// With -DPUBSUB_PACKED_LAYOUT both fields share cache line, which keeps bouncing between cores.
+typedef struct {
+    TQueue *queue;
+    long iterations;
+    pthread_barrier_t *start;
+} FieldWriter;
+
+static void *benchProducerField(void *w) {
+    FieldWriter *writer = w;
+    pthread_barrier_wait(writer->start);
+    for (long i = 0; i < writer->iterations; i++)
+        atomic_fetch_add_explicit(&writer->queue->tailSeq, 1, memory_order_relaxed);
+    return NULL;
+}
+
+static void *benchConsumerField(void *w) {
+    FieldWriter *writer = w;
+    pthread_barrier_wait(writer->start);
+    for (long i = 0; i < writer->iterations; i++)
+        atomic_fetch_add_explicit(&writer->queue->msgNumber, 1, memory_order_relaxed);
+    return NULL;
+}
+
+static void benchFalseSharing(long iterations) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    createQueueI(queue, 1);
+
+    int cycles = perfOpen(PERF_COUNT_HW_CPU_CYCLES);
+    int misses = perfOpen(PERF_COUNT_HW_CACHE_MISSES);
+
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, 3);
+    FieldWriter writer = { queue, iterations, &start };
+    pthread_t producer, consumer;
+    pthread_create(&producer, NULL, benchProducerField, &writer);
+    pthread_create(&consumer, NULL, benchConsumerField, &writer);
+
+    pthread_barrier_wait(&start);
+    uint64_t begin = nowNs();
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    uint64_t elapsed = nowNs() - begin;
+
+#ifdef PUBSUB_PACKED_LAYOUT
+    const char *layout = "packed";
+#else
+    const char *layout = "aligned";
+#endif
+    fprintf(stderr, "false sharing | %s layout | %.1f ns/op", layout, (double)elapsed / iterations);
+    if (cycles >= 0 && misses >= 0)
+        fprintf(stderr, " | %.1f cycles/op | %.3f cache misses/op\n",
+            (double)perfRead(cycles) / (2 * iterations), (double)perfRead(misses) / (2 * iterations));
+    else
+        fprintf(stderr, " | perf counters not available\n");
+
+    if (cycles >= 0)
+        close(cycles);
+    if (misses >= 0)
+        close(misses);
+    pthread_barrier_destroy(&start);
+    atomic_store(&queue->tailSeq, 0);
+    atomic_store(&queue->msgNumber, 0);
+    destroyQueueI(queue);
+}
+
+typedef struct {
+    TQueue *queue;
+    long messages;
+    int batch;
+    pthread_barrier_t *start;
+} Worker;
+
+static void *benchPublisher(void *w) {
+    Worker *worker = w;
+    void *msgs[worker->batch];
+    for (int i = 0; i < worker->batch; i++)
+        msgs[i] = worker;
+
+    pthread_barrier_wait(worker->start);
+    for (long i = 0; i < worker->messages;) {
+        int n = worker->messages - i < worker->batch ? worker->messages - i : worker->batch;
+        if (n == 1)
+            putI(worker->queue, worker);
+        else
+            n = putBatchI(worker->queue, msgs, n);
+        i += n;
+    }
+    return NULL;
+}
+
+static void *benchSubscriber(void *w) {
+    Worker *worker = w;
+    TSubscriberHandle handle = subscribeI(worker->queue, pthread_self());
+    void *msgs[worker->batch];
+    pthread_barrier_wait(worker->start);
+    for (long i = 0; i < worker->messages;) {
+        if (worker->batch == 1) {
+            getByHandleI(worker->queue, handle);
+            i++;
+        } else {
+            int n = getBatchI(worker->queue, handle, msgs, worker->batch);
+            if (n < 0)
+                break;
+            i += n;
+        }
+    }
+    return NULL;
+}
+
+// One publisher, several subscribers, everyone competes for queue mutex
+// With batch > 1 publisher uses putBatchI and subscribers getBatchI
+// Context switches per message show how many threads are woken without work
+static void benchContended(int msgMax, int subscribers, long messages, int batch) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    createQueueI(queue, msgMax);
+
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, subscribers + 2);
+
+    Worker worker = { queue, messages, batch, &start };
+    pthread_t pub, subs[subscribers];
+    for (int i = 0; i < subscribers; i++)
+        pthread_create(&subs[i], NULL, benchSubscriber, &worker);
+    pthread_create(&pub, NULL, benchPublisher, &worker);
+
+    pthread_barrier_wait(&start);
+    long switches = contextSwitches();
+    uint64_t begin = nowNs();
+    pthread_join(pub, NULL);
+    for (int i = 0; i < subscribers; i++)
+        pthread_join(subs[i], NULL);
+    uint64_t elapsed = nowNs() - begin;
+    switches = contextSwitches() - switches;
+
+    fprintf(stderr, "contended | msgMax %d | subscribers %d | batch %d | %.0f msgs/s | %.2f ctx switches/msg\n",
+        msgMax, subscribers, batch, messages / (elapsed / 1e9), (double)switches / messages);
+
+    pthread_barrier_destroy(&start);
+    destroyQueueI(queue);
+}
+
+static void benchMicro() {
+    benchHoldTime(64, 2000);
+    benchHoldTime(4096, 30);
+    benchCopy(64, 2000, 16);
+    benchCopy(64, 2000, MSG_INLINE_SIZE);
+    benchCopy(64, 2000, 1024);
+    benchPayload(64, 2000, 1024);
+    benchReserve(64, 2000, MSG_INLINE_SIZE);
+    benchReserve(64, 2000, 1024);
+    benchDepth(1000);
+    benchDepth(10000);
+    benchDepth(100000);
+    benchRemove(1000);
+    benchRemove(10000);
+    benchOverflow(64, 100000, OVERFLOW_DROP_OLDEST);
+    benchOverflow(64, 100000, OVERFLOW_DROP_NEWEST);
+    benchLag(1000, 1000);
+    benchSubscribers(2, 100000);
+    benchSubscribers(4000, 100000);
+    benchTopics(16, 10000);
+    benchTopics(4096, 40);
+    benchFalseSharing(10000000);
+    benchContended(64, 4, 100000, 1);
+    benchContended(64, 4, 100000, 16);
+    benchContended(64, 32, 20000, 1);
+}
+
+
+// -= Scenario cases =-
+// Publishers run for given duration, subscribers read until publishers are done and queue is empty.
+// Message points to payload stamped with publish time, subscriber records end-to-end latency.
+typedef struct {
+    uint64_t sentNs;
+    char data[];
+} Payload;
+
+typedef struct {
+    const char *name;
+    int publishers;
+    int subscribers;
+    int msgMax;
+    int payload;
+    int batch;
+    int duration;
+    int churn; // churn case, messages read between unsubscribe and subscribe again
+    TQueueConfig config;
+} Options;
+
+typedef struct {
+    TQueue *queue;
+    const Options *options;
+    pthread_barrier_t *start;
+    volatile bool *stop;
+    volatile bool *publishersDone;
+    char *pool; // payloads of publisher, freed once subscribers finished
+    long messages;
+    Histogram latency;
+    TLatencyHistogram queueLatency; // measured by traced queue (-DPUBSUB_TRACING)
+} Scenario;
+
+static void *scenarioPublisher(void *s) {
+    Scenario *scenario = s;
+    const Options *options = scenario->options;
+
+    // Payload is reused after the queue turned over twice, subscribers are done with it by then
+    int poolSize = 2 * options->msgMax + 1024;
+    size_t payloadSize = (sizeof(Payload) + options->payload + 63) & ~(size_t)63;
+    scenario->pool = aligned_alloc(64, payloadSize * poolSize);
+    void *msgs[options->batch];
+    int next = 0;
+
+    pthread_barrier_wait(scenario->start);
+    while (!*scenario->stop) {
+        uint64_t sentNs = nowNs();
+        for (int i = 0; i < options->batch; i++) {
+            Payload *payload = (Payload *)(scenario->pool + payloadSize * next);
+            next = (next + 1) % poolSize;
+            payload->sentNs = sentNs;
+            memset(payload->data, next, options->payload);
+            msgs[i] = payload;
+        }
+
+        int sent = 0;
+        while (sent < options->batch) {
+            int n = options->batch == 1 ?
+                (putI(scenario->queue, msgs[0]) == 0 ? 1 : -1) :
+                putBatchI(scenario->queue, msgs + sent, options->batch - sent);
+            if (n < 0)
+                break;
+            sent += n;
+        }
+        scenario->messages += sent;
+    }
+
+    lockWaitCollect();
+    return NULL;
+}
+
+// Adds latency histogram of subscriber kept by traced queue, called before it unsubscribes
+static void scenarioTraced(Scenario *scenario, TSubscriberHandle handle) {
+    TLatencyHistogram histogram;
+    if (!getLatencyHistogramI(scenario->queue, handle, &histogram))
+        return;
+
+    TLatencyHistogram *into = &scenario->queueLatency;
+    for (int i = 0; i < TRACE_BUCKETS; i++)
+        into->counts[i] += histogram.counts[i];
+    into->total += histogram.total;
+    if (histogram.max > into->max)
+        into->max = histogram.max;
+}
+
+static void *scenarioSubscriber(void *s) {
+    Scenario *scenario = s;
+    const Options *options = scenario->options;
+    TSubscriberHandle handle = subscribeI(scenario->queue, pthread_self());
+    void *msgs[options->batch];
+    long sinceSubscribe = 0;
+
+    pthread_barrier_wait(scenario->start);
+    while (true) {
+        struct timespec deadline = deadlineIn(10000000);
+        int n = getBatchWaitI(scenario->queue, handle, msgs, options->batch, 1, &deadline);
+        if (n < 0)
+            break;
+        if (n == 0) {
+            if (*scenario->publishersDone)
+                break;
+            continue;
+        }
+
+        uint64_t receivedNs = nowNs();
+        for (int i = 0; i < n; i++) {
+            Payload *payload = msgs[i];
+            histRecord(&scenario->latency, receivedNs - payload->sentNs);
+            // Touch every cache line of payload as a consumer would
+            volatile char sink;
+            for (int offset = 0; offset < options->payload; offset += 64)
+                sink = payload->data[offset];
+            (void)sink;
+        }
+        scenario->messages += n;
+
+        sinceSubscribe += n;
+        if (options->churn > 0 && sinceSubscribe >= options->churn) {
+            scenarioTraced(scenario, handle);
+            unsubscribeByHandleI(scenario->queue, handle);
+            handle = subscribeI(scenario->queue, pthread_self());
+            sinceSubscribe = 0;
+        }
+    }
+
+    scenarioTraced(scenario, handle);
+    unsubscribeByHandleI(scenario->queue, handle);
+    lockWaitCollect();
+    return NULL;
+}
+
+static void benchScenario(const Options *options) {
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    if (!createQueueConfigI(queue, options->msgMax, &options->config))
+        return;
+
+    int threads = options->publishers + options->subscribers;
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, threads + 1);
+    volatile bool stop = false;
+    volatile bool publishersDone = false;
+
+    // Subscribers first, so they are subscribed before the first message
+    Scenario *scenarios = calloc(threads, sizeof(Scenario));
+    pthread_t workers[threads];
+    for (int i = 0; i < threads; i++) {
+        scenarios[i].queue = queue;
+        scenarios[i].options = options;
+        scenarios[i].start = &start;
+        scenarios[i].stop = &stop;
+        scenarios[i].publishersDone = &publishersDone;
+        pthread_create(&workers[i], NULL, i < options->subscribers ? scenarioSubscriber : scenarioPublisher, &scenarios[i]);
+    }
+
+    memset(&lockWait, 0, sizeof(LockWait));
+    pthread_barrier_wait(&start);
+    long switches = contextSwitches();
+    uint64_t begin = nowNs();
+
+    sleep(options->duration);
+    stop = true;
+    for (int i = options->subscribers; i < threads; i++)
+        pthread_join(workers[i], NULL);
+    uint64_t elapsed = nowNs() - begin;
+    publishersDone = true;
+    for (int i = 0; i < options->subscribers; i++)
+        pthread_join(workers[i], NULL);
+    switches = contextSwitches() - switches;
+
+    long published = 0, delivered = 0;
+    Histogram *latency = calloc(1, sizeof(Histogram));
+    TLatencyHistogram *queueLatency = calloc(1, sizeof(TLatencyHistogram));
+    for (int i = 0; i < threads; i++) {
+        if (i < options->subscribers) {
+            delivered += scenarios[i].messages;
+            histMerge(latency, &scenarios[i].latency);
+            for (int b = 0; b < TRACE_BUCKETS; b++)
+                queueLatency->counts[b] += scenarios[i].queueLatency.counts[b];
+            queueLatency->total += scenarios[i].queueLatency.total;
+            if (scenarios[i].queueLatency.max > queueLatency->max)
+                queueLatency->max = scenarios[i].queueLatency.max;
+        } else {
+            published += scenarios[i].messages;
+            free(scenarios[i].pool);
+        }
+    }
+
+    double seconds = elapsed / 1e9;
+    fprintf(stderr, "%-9s | %s | publishers %d | subscribers %d | msgMax %d | payload %d B | batch %d\n",
+        options->name, options->config.engine == ENGINE_RING ? "ring"
+            : options->config.reclaim == RECLAIM_MIN_CURSOR ? "list cursor"
+            : options->config.reclaim == RECLAIM_HAZARD ? "list hazard" : "list",
+        options->publishers, options->subscribers, options->msgMax, options->payload, options->batch);
+    fprintf(stderr, "          | %.0f msgs/s published | %.0f msgs/s delivered | %.2f ctx switches/msg\n",
+        published / seconds, delivered / seconds, published > 0 ? (double)switches / published : 0.0);
+    fprintf(stderr, "          | latency ns | p50 %llu | p90 %llu | p99 %llu | p99.9 %llu | max %llu\n",
+        (unsigned long long)histPercentile(latency, 50), (unsigned long long)histPercentile(latency, 90),
+        (unsigned long long)histPercentile(latency, 99), (unsigned long long)histPercentile(latency, 99.9),
+        (unsigned long long)latency->max);
+    if (queueLatency->total > 0) {
+        fprintf(stderr, "          | queue latency ns | p50 %llu | p90 %llu | p99 %llu | p99.9 %llu | max %llu\n",
+            (unsigned long long)latencyPercentileI(queueLatency, 50), (unsigned long long)latencyPercentileI(queueLatency, 90),
+            (unsigned long long)latencyPercentileI(queueLatency, 99), (unsigned long long)latencyPercentileI(queueLatency, 99.9),
+            (unsigned long long)queueLatency->max);
+    }
+    TQueueStats stats;
+    getQueueStatsI(queue, &stats);
+    fprintf(stderr, "          | queue | %llu blocked puts | %llu blocked gets | %.1f ms blocked | depth high-water %llu\n",
+        (unsigned long long)stats.blockedPuts, (unsigned long long)stats.blockedGets, stats.blockedNs / 1e6,
+        (unsigned long long)stats.depthHighWater);
+    if (options->config.overflow != OVERFLOW_BLOCK) {
+        TOverflowStats overflow = getOverflowStatsI(queue);
+        fprintf(stderr, "          | overflow | %llu oldest dropped | %llu newest dropped | %llu subscribers evicted\n",
+            (unsigned long long)overflow.droppedOldest, (unsigned long long)overflow.droppedNewest,
+            (unsigned long long)overflow.evictedSubscribers);
+    }
+#ifdef BENCH_WRAP_LOCK
+    fprintf(stderr, "          | lock wait | %.1f ms total | %.2f%% of thread time | %.2f%% acquisitions contended\n",
+        lockWait.waitNs / 1e6, 100.0 * lockWait.waitNs / ((double)elapsed * threads),
+        lockWait.acquired > 0 ? 100.0 * lockWait.contended / lockWait.acquired : 0.0);
+#else
+    fprintf(stderr, "          | lock wait | n/a, build with -DBENCH_WRAP_LOCK -Wl,--wrap=pthread_mutex_lock\n");
+#endif
+#ifdef PUBSUB_LOCK_PROFILE
+    dumpLockProfileI(queue, stderr);
+#endif
+
+    free(latency);
+    free(queueLatency);
+    free(scenarios);
+    pthread_barrier_destroy(&start);
+    destroyQueueI(queue);
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s [-c micro|fanout|fanin|churn] [-p publishers] [-s subscribers] [-m msgMax]\n"
+        "          [-l payload bytes] [-b batch] [-d seconds] [-u churn interval] [-e list|ring]\n"
+        "          [-w park|spin|yield|spinpark] [-o block|oldest|newest|evict] [-r receivers|cursor|hazard]\n", program);
+}
+
+int main(int argc, char **argv) {
+    Options options = {
+        .name = "micro",
+        .msgMax = 1024,
+        .payload = 64,
+        .batch = 1,
+        .duration = 3,
+        .config = { .engine = ENGINE_LIST, .wait = WAIT_DEFAULT },
+    };
+#ifdef PUBSUB_TRACING
+    options.config.tracing = true;
+#endif
+
+    int option;
+    while ((option = getopt(argc, argv, "c:p:s:m:l:b:d:u:e:w:o:r:")) != -1) {
+        switch (option) {
+            case 'c': options.name = optarg; break;
+            case 'p': options.publishers = atoi(optarg); break;
+            case 's': options.subscribers = atoi(optarg); break;
+            case 'm': options.msgMax = atoi(optarg); break;
+            case 'l': options.payload = atoi(optarg); break;
+            case 'b': options.batch = atoi(optarg); break;
+            case 'd': options.duration = atoi(optarg); break;
+            case 'u': options.churn = atoi(optarg); break;
+            case 'e': options.config.engine = strcmp(optarg, "ring") == 0 ? ENGINE_RING : ENGINE_LIST; break;
+            case 'w':
+                if (strcmp(optarg, "park") == 0) options.config.wait = WAIT_PARK;
+                else if (strcmp(optarg, "spin") == 0) options.config.wait = WAIT_SPIN;
+                else if (strcmp(optarg, "yield") == 0) options.config.wait = WAIT_SPIN_YIELD;
+                else if (strcmp(optarg, "spinpark") == 0) options.config.wait = WAIT_SPIN_PARK;
+                break;
+            case 'o':
+                if (strcmp(optarg, "oldest") == 0) options.config.overflow = OVERFLOW_DROP_OLDEST;
+                else if (strcmp(optarg, "newest") == 0) options.config.overflow = OVERFLOW_DROP_NEWEST;
+                else if (strcmp(optarg, "evict") == 0) options.config.overflow = OVERFLOW_EVICT_SLOWEST;
+                break;
+            case 'r':
+                if (strcmp(optarg, "cursor") == 0) options.config.reclaim = RECLAIM_MIN_CURSOR;
+                else if (strcmp(optarg, "hazard") == 0) options.config.reclaim = RECLAIM_HAZARD;
+                else options.config.reclaim = RECLAIM_RECEIVERS;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (strcmp(options.name, "micro") == 0) {
+        benchMicro();
+        return 0;
+    }
+
+    // Case defaults, explicit options win
+    if (strcmp(options.name, "fanout") == 0) {
+        if (options.publishers == 0) options.publishers = 1;
+        if (options.subscribers == 0) options.subscribers = MAX_SUBS;
+    } else if (strcmp(options.name, "fanin") == 0) {
+        if (options.publishers == 0) options.publishers = 8;
+        if (options.subscribers == 0) options.subscribers = 1;
+    } else if (strcmp(options.name, "churn") == 0) {
+        if (options.publishers == 0) options.publishers = 2;
+        if (options.subscribers == 0) options.subscribers = 8;
+        if (options.churn == 0) options.churn = 1000;
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int subscribersMax = options.config.engine == ENGINE_RING ? MAX_SUBS : SUB_CHUNK_SIZE * SUB_CHUNKS_MAX;
+    if (options.subscribers > subscribersMax || options.batch < 1 || options.msgMax < 1 || options.payload < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    benchScenario(&options);
+    return 0;
+}
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "structures.h"
+#include "logger.h"
+
+// Topic broker
+// Owns named topics, each topic is separate TQueue, so publishers and subscribers of unrelated topics
+// never share a lock. Topics live in fixed open-addressing table of one cache line entries.
+// Lookup is lock-free: hash of the name, then usually single entry read.
+// Only topic creation locks, and only the shard which the name hash falls into.
+
+// -= Queue (pubSubInterface.c) =-
+bool createQueueConfigI(TQueue *queue, int size, const TQueueConfig *config);
+void destroyQueueI(TQueue *queue);
+TSubscriberHandle subscribeI(TQueue *queue, pthread_t thread);
+int putI(TQueue *queue, void *msg);
+
+_Static_assert(sizeof(TTopic) == CACHE_LINE, "TTopic must fill exactly one cache line");
+_Static_assert((BROKER_SHARDS & (BROKER_SHARDS - 1)) == 0, "BROKER_SHARDS must be power of two");
+
+
+// -= Supportive functions =-
+// FNV-1a, 0 is reserved for free entries
+static uint64_t topicHash(const char *name) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const unsigned char *c = (const unsigned char *)name; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ull;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// Table index uses low bits of hash, shard the high ones
+static BrokerShard *topicShard(TBroker *broker, uint64_t hash) {
+    return &broker->shards[(hash >> 32) & (BROKER_SHARDS - 1)];
+}
+
+// Returns created topic with given name or NULL, entries still being created are skipped
+// Table is never full, so probing always reaches free entry
+static TTopic *topicFind(TBroker *broker, const char *name, uint64_t hash) {
+    for (uint64_t i = hash & broker->mask;; i = (i + 1) & broker->mask) {
+        TTopic *topic = &broker->topics[i];
+        uint64_t entryHash = atomic_load_explicit(&topic->hash, memory_order_acquire);
+        if (entryHash == 0)
+            return NULL;
+
+        // Name is written before queue is published
+        if (entryHash == hash && atomic_load_explicit(&topic->queue, memory_order_acquire) != NULL
+            && strcmp(topic->name, name) == 0)
+            return topic;
+    }
+}
+
+// Claims free entry for hash, other shards may claim entries concurrently
+static TTopic *topicClaim(TBroker *broker, uint64_t hash) {
+    for (uint64_t i = hash & broker->mask;; i = (i + 1) & broker->mask) {
+        TTopic *topic = &broker->topics[i];
+        uint64_t expected = 0;
+        if (atomic_load_explicit(&topic->hash, memory_order_relaxed) == 0
+            && atomic_compare_exchange_strong(&topic->hash, &expected, hash))
+            return topic;
+    }
+}
+
+
+// -= Interfaces =-
+// Topics are created with msgMax topicSize and given queue config (NULL - list engine)
+// Returns false if table could not be allocated
+bool createBrokerI(TBroker *broker, int maxTopics, int topicSize, const TQueueConfig *config) {
+    // At most half of entries is used, keeps probe sequences short
+    uint64_t capacity = 2;
+    while (capacity < 2 * (uint64_t)maxTopics)
+        capacity <<= 1;
+
+    broker->topics = aligned_alloc(CACHE_LINE, capacity * sizeof(TTopic));
+    if (broker->topics == NULL) {
+        LOG_ERROR("[B] - Failed to allocate topic table | Broker not initialized\n");
+        return false;
+    }
+    memset(broker->topics, 0, capacity * sizeof(TTopic));
+
+    broker->mask = capacity - 1;
+    broker->maxTopics = maxTopics;
+    atomic_init(&broker->topicNumber, 0);
+    broker->topicSize = topicSize;
+    if (config != NULL)
+        broker->config = *config;
+    else
+        broker->config = (TQueueConfig){ .engine = ENGINE_LIST };
+
+    for (int i = 0; i < BROKER_SHARDS; i++) {
+        pthread_mutex_init(&broker->shards[i].mutex, NULL);
+    }
+
+    LOG_INFO("[B] - Broker initialized\n");
+    return true;
+}
+
+// Destroys queues of all topics and frees the broker
+// No broker call may start after destroyBrokerI, threads waiting in topic queues are released as with destroyQueueI
+void destroyBrokerI(TBroker *broker) {
+    for (uint64_t i = 0; i <= broker->mask; i++) {
+        TQueue *queue = atomic_load(&broker->topics[i].queue);
+        if (queue != NULL)
+            destroyQueueI(queue);
+    }
+
+    for (int i = 0; i < BROKER_SHARDS; i++) {
+        pthread_mutex_destroy(&broker->shards[i].mutex);
+    }
+    free(broker->topics);
+    free(broker);
+
+    LOG_INFO("[B] - Broker destroyed\n");
+}
+
+// Returns queue of the topic, NULL if topic does not exist, never locks
+TQueue *findTopicI(TBroker *broker, const char *name) {
+    TTopic *topic = topicFind(broker, name, topicHash(name));
+    return topic != NULL ? atomic_load_explicit(&topic->queue, memory_order_acquire) : NULL;
+}
+
+// Returns queue of the topic, creates it if it does not exist
+// Returns NULL if name is too long, broker is full or queue could not be allocated
+TQueue *createTopicI(TBroker *broker, const char *name) {
+    uint64_t hash = topicHash(name);
+    TTopic *topic = topicFind(broker, name, hash);
+    if (topic != NULL)
+        return atomic_load_explicit(&topic->queue, memory_order_acquire);
+
+    if (strlen(name) >= TOPIC_NAME_SIZE) {
+        LOG_ERROR("[B] - Topic name too long | Topic not created\n");
+        return NULL;
+    }
+
+    // Same name always maps to same shard, so it is created only once
+    BrokerShard *shard = topicShard(broker, hash);
+    pthread_mutex_lock(&shard->mutex);
+    topic = topicFind(broker, name, hash);
+    if (topic != NULL) {
+        pthread_mutex_unlock(&shard->mutex);
+        return atomic_load_explicit(&topic->queue, memory_order_acquire);
+    }
+
+    if (atomic_fetch_add(&broker->topicNumber, 1) >= broker->maxTopics) {
+        atomic_fetch_sub(&broker->topicNumber, 1);
+        pthread_mutex_unlock(&shard->mutex);
+        LOG_ERROR("[B] - Broker is full | Topic not created\n");
+        return NULL;
+    }
+
+    // Queue is ready before entry is claimed, failed creation leaves no entry behind
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+    if (queue == NULL || !createQueueConfigI(queue, broker->topicSize, &broker->config)) {
+        free(queue);
+        atomic_fetch_sub(&broker->topicNumber, 1);
+        pthread_mutex_unlock(&shard->mutex);
+        LOG_ERROR("[B] - Failed to create topic queue | Topic not created\n");
+        return NULL;
+    }
+
+    topic = topicClaim(broker, hash);
+    strcpy(topic->name, name);
+    atomic_store_explicit(&topic->queue, queue, memory_order_release);
+    pthread_mutex_unlock(&shard->mutex);
+
+    LOG_INFO("[B] - Topic %s created\n", name);
+    return queue;
+}
+
+// Like putI on the topic queue
+// Message to topic which does not exist has no subscribers, so it is dropped and 0 is returned
+int publishToTopicI(TBroker *broker, const char *name, void *msg) {
+    TQueue *queue = findTopicI(broker, name);
+    if (queue == NULL) {
+        LOG_DEBUG("[P] - Topic %s does not exist | Message dropped\n", name);
+        return 0;
+    }
+    return putI(queue, msg);
+}
+
+// Subscribes thread to the topic, creates the topic if it does not exist
+// Topic queue is stored to queue (for getByHandleI and other queue interfaces), returns 0 on failure
+TSubscriberHandle subscribeToTopicI(TBroker *broker, const char *name, pthread_t thread, TQueue **queue) {
+    TQueue *topicQueue = createTopicI(broker, name);
+    if (queue != NULL)
+        *queue = topicQueue;
+    if (topicQueue == NULL)
+        return 0;
+
+    return subscribeI(topicQueue, thread);
+}
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "logger.h"
+
+// Every thread writes records into its own ring (single producer), background writer thread
+// is the only consumer. Writer merges rings by record time, so output keeps order of calls
+// across threads as long as records are published before writer reaches them.
+// Full ring drops records instead of blocking, number of dropped ones is printed by writer.
+
+#define LOG_IDLE_NS 1000000 // writer sleep when all rings are empty
+
+typedef struct {
+    uint64_t time;
+    char text[LOG_RECORD_SIZE];
+} LogRecord;
+
+typedef struct LogRing {
+    _Atomic uint32_t head;    // next record for writer
+    _Atomic uint32_t tail;    // next free record for owning thread
+    _Atomic uint64_t dropped; // records lost because ring was full
+    _Atomic bool closed;      // owning thread exited, ring is freed once drained
+    struct LogRing *next;
+    LogRecord records[LOG_RING_SIZE];
+} LogRing;
+
+static _Atomic(LogRing *) rings;
+static __thread LogRing *threadRing;
+
+static pthread_once_t logOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t ringKey;
+static pthread_t writer;
+static bool isWriterRunning;
+static _Atomic bool writerStop;
+static pthread_mutex_t drainMutex = PTHREAD_MUTEX_INITIALIZER; // writer and logFlush drain in turns
+
+
+// -= Supportive functions =-
+static uint64_t logNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Prints all published records, oldest first (must be called with drainMutex held)
+static bool logDrain() {
+    bool wrote = false;
+    while (true) {
+        LogRing *oldest = NULL;
+        uint64_t oldestTime = 0;
+        for (LogRing *ring = atomic_load(&rings); ring != NULL; ring = ring->next) {
+            uint32_t head = atomic_load(&ring->head);
+            if (head == atomic_load(&ring->tail))
+                continue;
+
+            uint64_t time = ring->records[head & (LOG_RING_SIZE - 1)].time;
+            if (oldest == NULL || time < oldestTime) {
+                oldest = ring;
+                oldestTime = time;
+            }
+        }
+        if (oldest == NULL)
+            break;
+
+        uint32_t head = atomic_load(&oldest->head);
+        fputs(oldest->records[head & (LOG_RING_SIZE - 1)].text, stdout);
+        atomic_store(&oldest->head, head + 1);
+        wrote = true;
+    }
+
+    // Report drops and free rings of exited threads, only writer unlinks so pushes at list head stay safe
+    LogRing *previous = NULL;
+    LogRing *ring = atomic_load(&rings);
+    while (ring != NULL) {
+        LogRing *next = ring->next;
+        uint64_t dropped = atomic_exchange(&ring->dropped, 0);
+        if (dropped > 0) {
+            printf("[L] - Log ring full | %llu records dropped\n", (unsigned long long)dropped);
+            wrote = true;
+        }
+
+        bool isDrained = atomic_load(&ring->head) == atomic_load(&ring->tail);
+        if (atomic_load(&ring->closed) && isDrained) {
+            LogRing *expected = ring;
+            if (previous != NULL) {
+                previous->next = next;
+                free(ring);
+                ring = next;
+                continue;
+            }
+            if (atomic_compare_exchange_strong(&rings, &expected, next)) {
+                free(ring);
+                ring = next;
+                continue;
+            }
+        }
+        previous = ring;
+        ring = next;
+    }
+
+    if (wrote)
+        fflush(stdout);
+    return wrote;
+}
+
+static void *logWriter(void *arg) {
+    struct timespec idle = { 0, LOG_IDLE_NS };
+    while (!atomic_load(&writerStop)) {
+        pthread_mutex_lock(&drainMutex);
+        bool wrote = logDrain();
+        pthread_mutex_unlock(&drainMutex);
+        if (!wrote)
+            nanosleep(&idle, NULL);
+    }
+    return NULL;
+}
+
+static void logThreadExit(void *ring) {
+    atomic_store(&((LogRing *)ring)->closed, true);
+}
+
+static void logStop() {
+    atomic_store(&writerStop, true);
+    if (isWriterRunning)
+        pthread_join(writer, NULL);
+    logFlush();
+}
+
+static void logStart() {
+    pthread_key_create(&ringKey, logThreadExit);
+    isWriterRunning = pthread_create(&writer, NULL, logWriter, NULL) == 0;
+    atexit(logStop);
+}
+
+static LogRing *logRegister() {
+    pthread_once(&logOnce, logStart);
+
+    LogRing *ring = calloc(1, sizeof(LogRing));
+    if (ring == NULL)
+        return NULL;
+
+    LogRing *head = atomic_load(&rings);
+    do {
+        ring->next = head;
+    } while (!atomic_compare_exchange_weak(&rings, &head, ring));
+
+    pthread_setspecific(ringKey, ring);
+    threadRing = ring;
+    return ring;
+}
+
+
+// -= Interfaces =-
+// Formats record into ring of calling thread, never blocks
+void logWrite(const char *format, ...) {
+    LogRing *ring = threadRing != NULL ? threadRing : logRegister();
+    if (ring == NULL)
+        return;
+
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - atomic_load(&ring->head) == LOG_RING_SIZE) {
+        atomic_fetch_add(&ring->dropped, 1);
+        return;
+    }
+
+    LogRecord *record = &ring->records[tail & (LOG_RING_SIZE - 1)];
+    record->time = logNow();
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(record->text, LOG_RECORD_SIZE, format, args);
+    va_end(args);
+
+    // Keep line ending of truncated record
+    if (length >= LOG_RECORD_SIZE)
+        record->text[LOG_RECORD_SIZE - 2] = '\n';
+
+    atomic_store(&ring->tail, tail + 1);
+}
+
+// Prints all records written so far, called automatically at exit
+void logFlush() {
+    pthread_mutex_lock(&drainMutex);
+    logDrain();
+    pthread_mutex_unlock(&drainMutex);
+}
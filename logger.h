@@ -0,0 +1,40 @@
+#pragma once
+
+// Asynchronous logger
+// Calls below LOG_LEVEL compile to nothing, the rest only formats record into ring of calling thread,
+// background writer prints records, so logging never takes stdio lock nor calls write inside critical section.
+// Build with -DLOG_LEVEL=0 to remove all queue logs (benchmarks).
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1 // failures (allocation, subscription)
+#define LOG_LEVEL_INFO 2  // queue life cycle, subscriptions, remove, resize
+#define LOG_LEVEL_DEBUG 3 // every put, get and wait
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_RING_SIZE 512 // records per thread, must be power of two
+#define LOG_RECORD_SIZE 112 // max length of one formatted record
+
+void logWrite(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void logFlush(void);
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logWrite(__VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
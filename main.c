@@ -11,14 +11,28 @@
 
 // -= Interfaces =-
 void createQueueI(TQueue *queue, int size);
+bool createQueueConfigI(TQueue *queue, int size, const TQueueConfig *config);
 void destroyQueueI(TQueue *queue);
-bool subscribeI(TQueue *queue, pthread_t thread);
+TSubscriberHandle subscribeI(TQueue *queue, pthread_t thread);
 void unsubscribeI(TQueue *queue, pthread_t thread);
 int putI(TQueue *queue, void *msg);
+int putBatchI(TQueue *queue, void **msgs, int n);
+int putCopyI(TQueue *queue, const void *buf, int len);
+int getCopyI(TQueue *queue, TSubscriberHandle handle, void *buf, int capacity);
+int getBatchI(TQueue *queue, TSubscriberHandle handle, void **out, int max);
 void *getI(TQueue *queue, pthread_t thread);
 int getAvailableI(TQueue *queue, pthread_t thread);
 void removeI(TQueue *queue, void *msg);
 void setSizeI(TQueue *queue, int size);
+bool createBrokerI(TBroker *broker, int maxTopics, int topicSize, const TQueueConfig *config);
+void destroyBrokerI(TBroker *broker);
+int publishToTopicI(TBroker *broker, const char *name, void *msg);
+TSubscriberHandle subscribeToTopicI(TBroker *broker, const char *name, pthread_t thread, TQueue **queue);
+void *getByHandleI(TQueue *queue, TSubscriberHandle handle);
+TPutSlot reservePutI(TQueue *queue, int len);
+int commitPutI(TQueue *queue, TPutSlot slot);
+bool setOverflowPolicyI(TQueue *queue, QueueOverflowPolicy policy);
+void getQueueStatsI(TQueue *queue, TQueueStats *stats);
 
 // -= Worker functions =-
 void *subscriber(void *q) {
@@ -63,6 +77,219 @@ void *publisher(void *q) {
     return NULL;
 }
 
+// Publisher in copy mode, queue keeps its own copy of the counter, so it can change right after put
+void *copyPublisher(void *q) {
+    TQueue *queue = (TQueue*)q;
+
+    int i = 0;
+    while (true) {
+        if (i==9) i=0;
+        else i++;
+
+        if (putCopyI(queue, &i, sizeof(i)) == -1)
+            break;
+
+        sleep(1);
+    }
+    printf("[P] - End of work\n");
+    return NULL;
+}
+
+// Subscriber in copy mode, payload is copied out of the queue
+void *copySubscriber(void *q) {
+    TQueue *queue = (TQueue*)q;
+    TSubscriberHandle handle = subscribeI(queue, pthread_self());
+    if (!handle) return NULL;
+
+    int value;
+    while (getCopyI(queue, handle, &value, sizeof(value)) != -1) {
+        printf("[S] - New message received: %d\n", value);
+        sleep(1);
+    }
+    printf("[S] - End of work\n");
+    return NULL;
+}
+
+#define BATCH_SIZE 5
+
+// Publisher in batch mode, whole batch is put with single call
+void *batchPublisher(void *q) {
+    TQueue *queue = (TQueue*)q;
+
+    int values[BATCH_SIZE];
+    void *batch[BATCH_SIZE];
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        values[i] = i;
+        batch[i] = &values[i];
+    }
+
+    while (true) {
+        // Put rest of the batch if only part of it fit in queue
+        int sent = 0;
+        while (sent < BATCH_SIZE) {
+            int added = putBatchI(queue, batch + sent, BATCH_SIZE - sent);
+            if (added == -1) {
+                printf("[P] - End of work\n");
+                return NULL;
+            }
+            sent += added;
+        }
+        printf("[P] - Batch of %d messages sent\n", BATCH_SIZE);
+
+        sleep(1);
+    }
+}
+
+#define TOPIC_NAMES 3
+#define TOPIC_ROUNDS 10
+
+static const char *topicNames[TOPIC_NAMES] = { "weather", "traffic", "news" };
+
+typedef struct {
+    TBroker *broker;
+    int topic; // index in topicNames
+} TopicWorker;
+
+// Subscriber of one broker topic
+void *topicSubscriber(void *w) {
+    TopicWorker *worker = (TopicWorker*)w;
+    const char *name = topicNames[worker->topic];
+    TQueue *queue;
+    TSubscriberHandle handle = subscribeToTopicI(worker->broker, name, pthread_self(), &queue);
+    if (!handle) return NULL;
+
+    int *newMsg;
+    while ((newMsg = getByHandleI(queue, handle)) != NULL) {
+        printf("[S] - New message received from %s: %d\n", name, *newMsg);
+    }
+    printf("[S] - End of work\n");
+    return NULL;
+}
+
+// Publisher which sends its counter to all topics in turn, TOPIC_ROUNDS times
+void *topicPublisher(void *w) {
+    TopicWorker *worker = (TopicWorker*)w;
+
+    int values[TOPIC_NAMES] = { 0 };
+    for (int round = 0; round < TOPIC_ROUNDS; round++) {
+        for (int t = 0; t < TOPIC_NAMES; t++) {
+            values[t]++;
+            if (publishToTopicI(worker->broker, topicNames[t], &values[t]) == -1) {
+                printf("[P] - End of work\n");
+                return NULL;
+            }
+        }
+        sleep(1);
+    }
+    printf("[P] - End of work\n");
+    return NULL;
+}
+
+#define STRESS_LENGTH 64
+#define STRESS_VALUES 256
+#define STRESS_SECONDS 10
+
+static int stressValues[STRESS_VALUES]; // stressValues[i] == i, pointer messages of stress test
+static _Atomic bool stressRunning;
+
+// Stress publisher in copy mode, message is its counter followed by low byte of the counter repeated
+void *stressCopyPublisher(void *q) {
+    TQueue *queue = (TQueue*)q;
+
+    unsigned char msg[STRESS_LENGTH];
+    for (unsigned counter = 1;; counter++) {
+        memcpy(msg, &counter, sizeof(counter));
+        memset(msg + sizeof(counter), (unsigned char)counter, STRESS_LENGTH - sizeof(counter));
+        if (putCopyI(queue, msg, STRESS_LENGTH) == -1)
+            break;
+    }
+    printf("[P] - End of work\n");
+    return NULL;
+}
+
+// Stress publisher of pointers into stressValues, remover removes them again
+void *stressPointerPublisher(void *q) {
+    TQueue *queue = (TQueue*)q;
+
+    for (int i = 0;; i = (i + 1) % STRESS_VALUES) {
+        if (putI(queue, &stressValues[i]) == -1)
+            break;
+    }
+    printf("[P] - End of work\n");
+    return NULL;
+}
+
+// Stress subscriber reading copies, counters must grow (setSizeI drops some) and content must match
+void *stressCopySubscriber(void *q) {
+    TQueue *queue = (TQueue*)q;
+    TSubscriberHandle handle = subscribeI(queue, pthread_self());
+    if (!handle) return NULL;
+
+    unsigned char msg[STRESS_LENGTH];
+    unsigned last = 0;
+    int received = 0, errors = 0;
+    int length;
+    while ((length = getCopyI(queue, handle, msg, sizeof(msg))) != -1) {
+        // Pointer messages have nothing to copy
+        if (length != STRESS_LENGTH)
+            continue;
+
+        unsigned counter;
+        memcpy(&counter, msg, sizeof(counter));
+        bool isValid = counter > last;
+        for (int i = sizeof(counter); i < STRESS_LENGTH; i++) {
+            isValid = isValid && msg[i] == (unsigned char)counter;
+        }
+        if (!isValid) {
+            printf("[S] - Corrupted message received: %u after %u\n", counter, last);
+            errors++;
+        }
+        last = counter;
+        received++;
+    }
+    printf("[S] - End of work, %d copies received, %d corrupted\n", received, errors);
+    return NULL;
+}
+
+// Stress subscriber reading batches, pointer messages must point to their own index
+void *stressBatchSubscriber(void *q) {
+    TQueue *queue = (TQueue*)q;
+    TSubscriberHandle handle = subscribeI(queue, pthread_self());
+    if (!handle) return NULL;
+
+    void *msgs[BATCH_SIZE];
+    int received = 0, errors = 0;
+    int count;
+    while ((count = getBatchI(queue, handle, msgs, BATCH_SIZE)) > 0) {
+        for (int i = 0; i < count; i++) {
+            if (msgs[i] == MSG_COPIED)
+                continue;
+
+            int *value = msgs[i];
+            if (value < stressValues || value >= stressValues + STRESS_VALUES || *value != value - stressValues) {
+                printf("[S] - Corrupted pointer received\n");
+                errors++;
+            }
+            received++;
+        }
+    }
+    printf("[S] - End of work, %d pointers received, %d corrupted\n", received, errors);
+    return NULL;
+}
+
+// Removes random pointer messages while stress test runs
+void *stressRemover(void *q) {
+    TQueue *queue = (TQueue*)q;
+
+    unsigned seed = 1;
+    while (atomic_load(&stressRunning)) {
+        removeI(queue, &stressValues[rand_r(&seed) % STRESS_VALUES]);
+        usleep(100);
+    }
+    printf("[R] - End of work\n");
+    return NULL;
+}
+
 void *remover(void *q) {
     TQueue *queue = (TQueue*)q;
     int msg = 123;
@@ -73,6 +300,21 @@ void *remover(void *q) {
     return NULL;
 }
 
+// Reserves one message, in full queue it waits until space is freed or overflow policy drops it
+void *reservePublisher(void *q) {
+    TQueue *queue = (TQueue*)q;
+    TPutSlot slot = reservePutI(queue, sizeof(int));
+    if (slot.data == NULL) {
+        printf("[P] - Reservation dropped\n");
+        return NULL;
+    }
+
+    *(int *)slot.data = 2;
+    commitPutI(queue, slot);
+    printf("[P] - Reserved message committed\n");
+    return NULL;
+}
+
 int main() {
     // TEST SECTION
     // PLEASE UNCOMMENT CHOOSEN TEST
@@ -91,7 +333,7 @@ int main() {
     pthread_t rem1;
     pthread_t sub1, sub2, sub3, sub4, sub5;
 
-    TQueue *queue = malloc(sizeof(TQueue));
+    TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
     createQueueI(queue, 4);
 
     pthread_create(&pub1, NULL, publisher, queue);
@@ -137,7 +379,7 @@ int main() {
         // pthread_t pub1, pub2, pub3;
         // pthread_t sub1, sub2, sub3, sub4, sub5, sub6;
 
-        // TQueue *queue = malloc(sizeof(TQueue));
+        // TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
         // createQueueI(queue, 10);
 
         // pthread_create(&pub1, NULL, publisher, queue);
@@ -171,5 +413,239 @@ int main() {
     // UNCOMMENT >>
     // # -------------------------------------------------------------
 
+
+
+    // # Case 3 --------------------------------------------------
+    // Same as case 2, but queue uses lock-free ring engine
+    // 3 publishers, 6 subscribers
+    // After 3 seconds, one subscriber (number 1) will be unsubscribed
+    // Starting size 10, after next 5 sec reducing to size 5
+    // Destroying queue after next 60 seconds
+    // UNCOMMENT >>
+        // printf("STARTING TEST CASE 3\n\n");
+        // pthread_t pub1, pub2, pub3;
+        // pthread_t sub1, sub2, sub3, sub4, sub5, sub6;
+
+        // TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+        // TQueueConfig config = { .engine = ENGINE_RING, .ringCapacity = 16 };
+        // createQueueConfigI(queue, 10, &config);
+
+        // pthread_create(&pub1, NULL, publisher, queue);
+        // pthread_create(&pub2, NULL, publisher, queue);
+        // pthread_create(&pub3, NULL, publisher, queue);
+        // pthread_create(&sub1, NULL, subscriber, queue);
+        // pthread_create(&sub2, NULL, subscriber, queue);
+        // pthread_create(&sub3, NULL, subscriber, queue);
+        // pthread_create(&sub4, NULL, subscriber, queue);
+        // pthread_create(&sub5, NULL, subscriber, queue);
+        // pthread_create(&sub6, NULL, subscriber, queue);
+
+        // sleep(3);
+        // unsubscribeI(queue, sub1);
+
+        // sleep(5);
+        // setSizeI(queue, 5);
+
+        // sleep(60);
+        // destroyQueueI(queue);
+
+        // pthread_join(pub1, NULL);
+        // pthread_join(pub2, NULL);
+        // pthread_join(pub3, NULL);
+        // pthread_join(sub1, NULL);
+        // pthread_join(sub2, NULL);
+        // pthread_join(sub3, NULL);
+        // pthread_join(sub4, NULL);
+        // pthread_join(sub5, NULL);
+        // pthread_join(sub6, NULL);
+    // UNCOMMENT >>
+    // # -------------------------------------------------------------
+
+
+
+    // # Case 4 --------------------------------------------------
+    // 1 batch publisher, 3 subscribers
+    // Starting size 8, publisher sends 5 messages per batch, so second batch fits only partially
+    // Destroying queue after 20 seconds
+    // UNCOMMENT >>
+        // printf("STARTING TEST CASE 4\n\n");
+        // pthread_t pub1;
+        // pthread_t sub1, sub2, sub3;
+
+        // TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+        // createQueueI(queue, 8);
+
+        // pthread_create(&sub1, NULL, subscriber, queue);
+        // pthread_create(&sub2, NULL, subscriber, queue);
+        // pthread_create(&sub3, NULL, subscriber, queue);
+        // sleep(1);
+        // pthread_create(&pub1, NULL, batchPublisher, queue);
+
+        // sleep(20);
+        // destroyQueueI(queue);
+
+        // pthread_join(pub1, NULL);
+        // pthread_join(sub1, NULL);
+        // pthread_join(sub2, NULL);
+        // pthread_join(sub3, NULL);
+    // UNCOMMENT >>
+    // # -------------------------------------------------------------
+
+
+
+    // # Case 5 --------------------------------------------------
+    // Broker with 3 topics, 1 publisher sending to all of them, 2 subscribers per topic
+    // Topics are created by subscribers, each topic has own queue of size 4
+    // Destroying broker after publisher ends (TOPIC_ROUNDS seconds), subscribers are released by destroy
+    // UNCOMMENT >>
+        // printf("STARTING TEST CASE 5\n\n");
+        // pthread_t pub1;
+        // pthread_t subs[2 * TOPIC_NAMES];
+        // TopicWorker workers[TOPIC_NAMES];
+
+        // TBroker *broker = aligned_alloc(CACHE_LINE, sizeof(TBroker));
+        // createBrokerI(broker, 16, 4, NULL);
+
+        // for (int t = 0; t < TOPIC_NAMES; t++) {
+        //     workers[t] = (TopicWorker){ broker, t };
+        //     pthread_create(&subs[2 * t], NULL, topicSubscriber, &workers[t]);
+        //     pthread_create(&subs[2 * t + 1], NULL, topicSubscriber, &workers[t]);
+        // }
+        // sleep(1);
+        // pthread_create(&pub1, NULL, topicPublisher, &workers[0]);
+
+        // pthread_join(pub1, NULL);
+        // sleep(1);
+        // destroyBrokerI(broker);
+
+        // for (int i = 0; i < 2 * TOPIC_NAMES; i++)
+        //     pthread_join(subs[i], NULL);
+    // UNCOMMENT >>
+    // # -------------------------------------------------------------
+
+
+
+    // # Case 6 --------------------------------------------------
+    // Stress test of RECLAIM_HAZARD queue, subscribers read without queue mutex
+    // 1 copy publisher and 1 pointer publisher putting as fast as they can, 2 copy and 2 batch subscribers
+    // checking every message, remover removing pointer messages all the time
+    // Size changes between 16, 4, 32 and 1 ten times per second for STRESS_SECONDS seconds, then queue is destroyed
+    // UNCOMMENT >>
+        // printf("STARTING TEST CASE 6\n\n");
+        // pthread_t pub1, pub2;
+        // pthread_t rem1;
+        // pthread_t sub1, sub2, sub3, sub4;
+
+        // for (int i = 0; i < STRESS_VALUES; i++)
+        //     stressValues[i] = i;
+        // atomic_store(&stressRunning, true);
+
+        // TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+        // TQueueConfig config = { .engine = ENGINE_LIST, .reclaim = RECLAIM_HAZARD };
+        // createQueueConfigI(queue, 16, &config);
+
+        // pthread_create(&sub1, NULL, stressCopySubscriber, queue);
+        // pthread_create(&sub2, NULL, stressCopySubscriber, queue);
+        // pthread_create(&sub3, NULL, stressBatchSubscriber, queue);
+        // pthread_create(&sub4, NULL, stressBatchSubscriber, queue);
+        // sleep(1);
+        // pthread_create(&pub1, NULL, stressCopyPublisher, queue);
+        // pthread_create(&pub2, NULL, stressPointerPublisher, queue);
+        // pthread_create(&rem1, NULL, stressRemover, queue);
+
+        // int sizes[] = { 16, 4, 32, 1 };
+        // for (int i = 0; i < STRESS_SECONDS * 10; i++) {
+        //     setSizeI(queue, sizes[i % 4]);
+        //     usleep(100000);
+        // }
+
+        // atomic_store(&stressRunning, false);
+        // pthread_join(rem1, NULL);
+        // destroyQueueI(queue);
+
+        // pthread_join(pub1, NULL);
+        // pthread_join(pub2, NULL);
+        // pthread_join(sub1, NULL);
+        // pthread_join(sub2, NULL);
+        // pthread_join(sub3, NULL);
+        // pthread_join(sub4, NULL);
+    // UNCOMMENT >>
+    // # -------------------------------------------------------------
+
+
+
+    // # Case 7 --------------------------------------------------
+    // Same as case 2, but messages are copied into queue (putCopyI / getCopyI)
+    // 3 publishers, 6 subscribers
+    // After 3 seconds, one subscriber (number 1) will be unsubscribed
+    // Starting size 10, after next 5 sec reducing to size 5
+    // Destroying queue after next 60 seconds
+    // UNCOMMENT >>
+        // printf("STARTING TEST CASE 7\n\n");
+        // pthread_t pub1, pub2, pub3;
+        // pthread_t sub1, sub2, sub3, sub4, sub5, sub6;
+
+        // TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+        // createQueueI(queue, 10);
+
+        // pthread_create(&pub1, NULL, copyPublisher, queue);
+        // pthread_create(&pub2, NULL, copyPublisher, queue);
+        // pthread_create(&pub3, NULL, copyPublisher, queue);
+        // pthread_create(&sub1, NULL, copySubscriber, queue);
+        // pthread_create(&sub2, NULL, copySubscriber, queue);
+        // pthread_create(&sub3, NULL, copySubscriber, queue);
+        // pthread_create(&sub4, NULL, copySubscriber, queue);
+        // pthread_create(&sub5, NULL, copySubscriber, queue);
+        // pthread_create(&sub6, NULL, copySubscriber, queue);
+        
+        // sleep(3);
+        // unsubscribeI(queue, sub1);
+
+        // sleep(5);
+        // setSizeI(queue, 5);
+        
+        // sleep(60);
+        // destroyQueueI(queue);
+
+        // pthread_join(pub1, NULL);
+        // pthread_join(pub2, NULL);
+        // pthread_join(pub3, NULL);
+        // pthread_join(sub1, NULL);
+        // pthread_join(sub2, NULL);
+        // pthread_join(sub3, NULL);
+        // pthread_join(sub4, NULL);
+        // pthread_join(sub5, NULL);
+        // pthread_join(sub6, NULL);
+    // UNCOMMENT >>
+    // # -------------------------------------------------------------
+
+
+    // # Case 8 --------------------------------------------------
+    // Overflow policy changes while publisher waits in reservePutI
+    // Queue of size 1 is filled for subscriber which does not read, so reserve publisher waits for space
+    // After 1 second policy changes to OVERFLOW_DROP_NEWEST, reservation is dropped and queue stays full
+    // Destroying queue right after, it must not wait for the dropped reservation
+    // UNCOMMENT >>
+        // printf("STARTING TEST CASE 8\n\n");
+        // pthread_t pub1;
+        // int msg = 1;
+
+        // TQueue *queue = aligned_alloc(CACHE_LINE, sizeof(TQueue));
+        // createQueueI(queue, 1);
+        // subscribeI(queue, pthread_self());
+        // putI(queue, &msg);
+
+        // pthread_create(&pub1, NULL, reservePublisher, queue);
+        // sleep(1);
+        // setOverflowPolicyI(queue, OVERFLOW_DROP_NEWEST);
+        // pthread_join(pub1, NULL);
+
+        // TQueueStats stats;
+        // getQueueStatsI(queue, &stats);
+        // printf("Queue depth after dropped reservation: %d (1 expected)\n", stats.depth);
+        // destroyQueueI(queue);
+    // UNCOMMENT >>
+    // # -------------------------------------------------------------
+
     return 0;
 }
@@ -1,472 +1,2634 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
 #include <limits.h>
 #include <string.h>
 #include <unistd.h>
+#include <sched.h>
 #include <pthread.h>
 
 #include "structures.h"
+#include "logger.h"
+
+
+// -= Ring engine (ringEngine.c) =-
+bool ringCreate(TQueue *queue, int size, int capacity);
+void ringDestroy(TQueue *queue);
+TSubscriberHandle ringFindHandle(TQueue *queue, pthread_t thread);
+TSubscriberHandle ringSubscribe(TQueue *queue, pthread_t thread);
+void ringUnsubscribe(TQueue *queue, TSubscriberHandle handle);
+int ringPutBatch(TQueue *queue, void **msgs, int n, const struct timespec *deadline);
+int ringGetBatch(TQueue *queue, TSubscriberHandle handle, void **out, int max, int minCount, const struct timespec *deadline);
+int ringGetAvailable(TQueue *queue, TSubscriberHandle handle);
+uint64_t ringGetReadSeq(TQueue *queue, TSubscriberHandle handle);
+void ringRemove(TQueue *queue, void *msg);
+void ringSetSize(TQueue *queue, int size);
+void ringStats(TQueue *queue, TQueueStats *stats);
+
+
+// -= Layout checks =-
+// Producer (put) and consumer (get) hot fields must not share cache line, see TQueue sections
+#ifndef PUBSUB_PACKED_LAYOUT
+#define SAME_LINE(type, a, b) (offsetof(type, a) / CACHE_LINE == offsetof(type, b) / CACHE_LINE)
+_Static_assert(SAME_LINE(TQueue, tail, waitingPublishers), "TQueue producer section must fit one cache line");
+_Static_assert(SAME_LINE(TQueue, head, activeSubscribers), "TQueue consumer section must fit one cache line");
+_Static_assert(!SAME_LINE(TQueue, tailSeq, msgNumber), "TQueue producer and consumer sections share cache line");
+_Static_assert(!SAME_LINE(TQueue, mutex, tailSeq) && !SAME_LINE(TQueue, mutex, msgNumber), "TQueue hot sections share cache line with mutex");
+_Static_assert(!SAME_LINE(TQueue, subscriberChunks[SUB_CHUNKS_MAX - 1], mutex), "TQueue read-mostly section shares cache line with mutex");
+_Static_assert(sizeof(Subscriber) % CACHE_LINE == 0, "Subscriber slots must not share cache line");
+_Static_assert(offsetof(SubscriberChunk, subs) % CACHE_LINE == 0, "SubscriberChunk bitmaps share cache line with first slot");
+_Static_assert(sizeof(Message) % CACHE_LINE == 0, "Message nodes must not share cache line");
+_Static_assert(sizeof(TQueueThreadStats) == CACHE_LINE, "TQueueThreadStats must fill exactly one cache line");
+#endif
+
+char msgCopiedMarker;
+char msgLaggedOutMarker;
+
+
+// -= Queue lock =-
+// Every operation takes queue mutex through these. Build with -DPUBSUB_LOCK_PROFILE to count acquisitions,
+// contended acquisitions, wait and hold time per lock site, profile is written with mutex held.
+// Without it they only lock, unlock and wait.
+
+// Shared with ring engine
+uint64_t monotonicNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+#ifdef PUBSUB_LOCK_PROFILE
+// Ends hold time of site which holds mutex, returns current time
+static uint64_t lockReleased(TQueue *queue) {
+    uint64_t now = monotonicNs();
+    TLockSiteProfile *profile = &queue->lockProfile[queue->lockedSite];
+    uint64_t held = now - queue->lockedNs;
+    profile->holdNs += held;
+    if (held > profile->maxHoldNs)
+        profile->maxHoldNs = held;
+    return now;
+}
+#endif
+
+// Shared with ring engine
+void queueLock(TQueue *queue, QueueLockSite site) {
+#ifdef PUBSUB_LOCK_PROFILE
+    uint64_t waitNs = 0;
+    bool isContended = pthread_mutex_trylock(&queue->mutex) != 0;
+    if (isContended) {
+        uint64_t start = monotonicNs();
+        pthread_mutex_lock(&queue->mutex);
+        waitNs = monotonicNs() - start;
+    }
+
+    TLockSiteProfile *profile = &queue->lockProfile[site];
+    profile->acquisitions += 1;
+    profile->contended += isContended;
+    profile->waitNs += waitNs;
+    queue->lockedSite = site;
+    queue->lockedNs = monotonicNs();
+#else
+    pthread_mutex_lock(&queue->mutex);
+#endif
+}
+
+void queueUnlock(TQueue *queue) {
+#ifdef PUBSUB_LOCK_PROFILE
+    lockReleased(queue);
+#endif
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// Waits on condition variable until deadline (NULL waits without limit), returns like pthread_cond_timedwait
+static int queueWait(TQueue *queue, pthread_cond_t *cond, const struct timespec *deadline) {
+#ifdef PUBSUB_LOCK_PROFILE
+    QueueLockSite site = queue->lockedSite;
+    lockReleased(queue);
+#endif
+    int result = deadline == NULL ? pthread_cond_wait(cond, &queue->mutex)
+        : pthread_cond_timedwait(cond, &queue->mutex, deadline);
+#ifdef PUBSUB_LOCK_PROFILE
+    queue->lockedSite = site;
+    queue->lockedNs = monotonicNs();
+#endif
+    return result;
+}
+
+
+
+// -= Message pool =-
+// Nodes are preallocated for msgMax messages, so put and get do not call allocator inside critical section.
+// Build with -DPUBSUB_MALLOC_NODES to fall back to malloc/free per message (benchmark comparison).
+static bool poolGrow(TQueue *queue, int count) {
+    MessageChunk *chunk = aligned_alloc(CACHE_LINE, sizeof(MessageChunk) + sizeof(Message) * count);
+    if (chunk == NULL)
+        return false;
+
+    chunk->size = count;
+    chunk->next = queue->chunks;
+    queue->chunks = chunk;
+
+    for (int i = 0; i < count; i++) {
+        chunk->nodes[i].seq = MSG_SEQ_FREE;
+        chunk->nodes[i].next = queue->freeNodes;
+        queue->freeNodes = &chunk->nodes[i];
+    }
+    queue->poolSize += count;
+    return true;
+}
+
+static Message *poolAlloc(TQueue *queue) {
+#ifdef PUBSUB_MALLOC_NODES
+    return aligned_alloc(CACHE_LINE, sizeof(Message));
+#else
+    // Should not happen while msgNumber <= msgMax, grow as a fallback
+    if (queue->freeNodes == NULL && !poolGrow(queue, queue->poolSize > 0 ? queue->poolSize : 1))
+        return NULL;
+
+    Message *node = queue->freeNodes;
+    queue->freeNodes = node->next;
+    return node;
+#endif
+}
+
+static void bufferFree(TQueue *queue, void *buffer, int length);
+static void payloadDrop(TQueue *queue, TPayload *payload);
+
+static void poolFree(TQueue *queue, Message *node) {
+    if (node->length == MSG_REMOVED) {
+        queue->removedNodes -= 1;
+        // Removed message of RECLAIM_HAZARD queue kept its buffer, see removeMessage
+        if (queue->reclaim == RECLAIM_HAZARD)
+            node->length = node->receivers;
+    }
+    if (node->length > MSG_INLINE_SIZE)
+        bufferFree(queue, node->msg, node->length);
+    else if (node->length == MSG_PAYLOAD)
+        payloadDrop(queue, node->msg);
+
+#ifdef PUBSUB_MALLOC_NODES
+    free(node);
+#else
+    node->seq = MSG_SEQ_FREE;
+    node->msg = NULL;
+    node->next = queue->freeNodes;
+    queue->freeNodes = node;
+#endif
+}
+
+static void poolDestroy(TQueue *queue) {
+    while (queue->chunks != NULL) {
+        MessageChunk *chunk = queue->chunks;
+        queue->chunks = chunk->next;
+        free(chunk);
+    }
+    queue->freeNodes = NULL;
+    queue->poolSize = 0;
+}
+
+
+// -= Payload buffers =-
+// Payloads of putCopyI longer than MSG_INLINE_SIZE are copied into buffers from power of two size classes.
+// Free buffers are kept per queue and reused, lists are guarded by queue mutex, so buffer is taken
+// under the lock which enqueues or reserves the message.
+static int bufferClass(int length) {
+    if (length <= BUFFER_MIN_SIZE)
+        return 0;
+
+    int sizeClass = 64 - __builtin_clzll((uint64_t)length - 1) - __builtin_ctz(BUFFER_MIN_SIZE);
+    return sizeClass < BUFFER_CLASSES ? sizeClass : -1;
+}
+
+// Must be called with queue mutex held, mallocs only until free lists fill up
+static void *bufferAlloc(TQueue *queue, int length) {
+    int sizeClass = bufferClass(length);
+    if (sizeClass < 0)
+        return malloc(length);
+
+    void *buffer = queue->freeBuffers[sizeClass];
+    if (buffer == NULL)
+        return malloc((size_t)BUFFER_MIN_SIZE << sizeClass);
+
+    queue->freeBuffers[sizeClass] = *(void **)buffer;
+    return buffer;
+}
+
+// Must be called with queue mutex held
+static void bufferFree(TQueue *queue, void *buffer, int length) {
+    int sizeClass = bufferClass(length);
+    if (sizeClass < 0) {
+        free(buffer);
+        return;
+    }
+
+    *(void **)buffer = queue->freeBuffers[sizeClass];
+    queue->freeBuffers[sizeClass] = buffer;
+}
+
+// -= Payload references =-
+// Message node keeps one reference, dropped when node is freed (reclaim, removeI, setSizeI, destroyQueueI).
+// Release callback must not run under queue mutex, so payloads dropped to zero there are collected
+// and released by the caller after unlock.
+
+// Must be called with queue mutex held
+static void payloadDrop(TQueue *queue, TPayload *payload) {
+    if (atomic_fetch_sub(&payload->refs, 1) == 1) {
+        payload->nextReleased = queue->releasedPayloads;
+        queue->releasedPayloads = payload;
+    }
+}
+
+// Must be called with queue mutex held, returned payloads are released with payloadsRelease after unlock
+static TPayload *payloadsTake(TQueue *queue) {
+    TPayload *released = queue->releasedPayloads;
+    queue->releasedPayloads = NULL;
+    return released;
+}
+
+static void payloadsRelease(TPayload *released) {
+    while (released != NULL) {
+        TPayload *payload = released;
+        released = payload->nextReleased;
+        if (payload->release != NULL)
+            payload->release(payload);
+    }
+}
+
+static void bufferPoolDestroy(TQueue *queue) {
+    for (int c = 0; c < BUFFER_CLASSES; c++) {
+        while (queue->freeBuffers[c] != NULL) {
+            void *buffer = queue->freeBuffers[c];
+            queue->freeBuffers[c] = *(void **)buffer;
+            free(buffer);
+        }
+    }
+}
+
+
+// -= Subscriber table =-
+// Chunks of SUB_CHUNK_SIZE subscribers are added on demand and live until queue is destroyed.
+// Put visits only chunks marked in notifyChunks and inside them only idle or waiting subscribers,
+// so its cost follows number of interested subscribers, not table capacity.
+
+// Returns subscriber of slot or NULL if slot is outside allocated table, usable without mutex
+static Subscriber *subscriberAt(TQueue *queue, int slot) {
+    if (slot < 0 || slot >= SUB_CHUNK_SIZE * SUB_CHUNKS_MAX)
+        return NULL;
+
+    SubscriberChunk *chunk = atomic_load(&queue->subscriberChunks[slot / SUB_CHUNK_SIZE]);
+    return chunk != NULL ? &chunk->subs[slot % SUB_CHUNK_SIZE] : NULL;
+}
+
+static bool subscriberChunkAdd(TQueue *queue) {
+    if (queue->subscriberChunkCount == SUB_CHUNKS_MAX)
+        return false;
+
+    SubscriberChunk *chunk = aligned_alloc(CACHE_LINE, sizeof(SubscriberChunk));
+    if (chunk == NULL)
+        return false;
+
+    // Deadlines of timed reads are measured on monotonic clock
+    pthread_condattr_t monotonic;
+    pthread_condattr_init(&monotonic);
+    pthread_condattr_setclock(&monotonic, CLOCK_MONOTONIC);
+
+    chunk->active = 0;
+    chunk->idle = 0;
+    chunk->waiters = 0;
+    for (int i = 0; i < SUB_CHUNK_SIZE; i++) {
+        chunk->subs[i].threadId = -1;
+        atomic_init(&chunk->subs[i].generation, 0);
+        chunk->subs[i].nextMsg = NULL;
+        atomic_init(&chunk->subs[i].claimed, 0);
+        atomic_init(&chunk->subs[i].readSeq, 0);
+        atomic_init(&chunk->subs[i].skipped, 0);
+        pthread_cond_init(&chunk->subs[i].msgGetCall, &monotonic);
+        chunk->subs[i].waiting = 0;
+        chunk->subs[i].wakeSeq = 0;
+        chunk->subs[i].lagSinceNs = 0;
+        chunk->subs[i].laggedOut = 0;
+#ifdef PUBSUB_TRACING
+        chunk->subs[i].latency = NULL;
+#endif
+    }
+    pthread_condattr_destroy(&monotonic);
+
+    atomic_store(&queue->subscriberChunks[queue->subscriberChunkCount], chunk);
+    queue->subscriberChunkCount += 1;
+    return true;
+}
+
+static void subscriberChunksDestroy(TQueue *queue) {
+    for (int c = 0; c < queue->subscriberChunkCount; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        for (int i = 0; i < SUB_CHUNK_SIZE; i++) {
+            pthread_cond_destroy(&chunk->subs[i].msgGetCall);
+#ifdef PUBSUB_TRACING
+            free(chunk->subs[i].latency);
+#endif
+        }
+        free(chunk);
+    }
+    queue->subscriberChunkCount = 0;
+}
+
+// Keeps summary bit of chunk in sync with its idle and waiters bitmaps
+static void notifySummary(TQueue *queue, int chunkIndex) {
+    SubscriberChunk *chunk = queue->subscriberChunks[chunkIndex];
+    uint64_t bit = 1ull << (chunkIndex % 64);
+    if (chunk->idle | chunk->waiters)
+        queue->notifyChunks[chunkIndex / 64] |= bit;
+    else
+        queue->notifyChunks[chunkIndex / 64] &= ~bit;
+}
+
+// Marks subscriber which reached the tail, following put sets its next message (mutex held)
+static void setIdle(TQueue *queue, int slot, bool isIdle) {
+    SubscriberChunk *chunk = queue->subscriberChunks[slot / SUB_CHUNK_SIZE];
+    uint64_t bit = 1ull << (slot % SUB_CHUNK_SIZE);
+    chunk->idle = isIdle ? chunk->idle | bit : chunk->idle & ~bit;
+    notifySummary(queue, slot / SUB_CHUNK_SIZE);
+}
+
+static void setWaiting(TQueue *queue, int slot, bool isWaiting) {
+    SubscriberChunk *chunk = queue->subscriberChunks[slot / SUB_CHUNK_SIZE];
+    uint64_t bit = 1ull << (slot % SUB_CHUNK_SIZE);
+    chunk->waiters = isWaiting ? chunk->waiters | bit : chunk->waiters & ~bit;
+    notifySummary(queue, slot / SUB_CHUNK_SIZE);
+}
+
+
+// -= Subscriber handles =-
+// pthread_t based interfaces resolve handle once per thread and keep it in thread-local cache,
+// cache is dropped whenever subscriptionsVersion of the queue changes
+typedef struct {
+    TQueue *queue;
+    pthread_t thread;
+    uint32_t version;
+    TSubscriberHandle handle;
+} HandleCache;
+
+static __thread HandleCache handleCache;
+static _Atomic uint32_t versionSeed; // separates versions of queues reusing same address
+
+// Returns slot index of valid handle, otherwise -1 (must be called with mutex held)
+static int handleSlot(TQueue *queue, TSubscriberHandle handle) {
+    int slot = HANDLE_SLOT(handle);
+    Subscriber *sub = subscriberAt(queue, slot);
+    if (
+        sub == NULL ||
+        sub->threadId == -1 ||
+        atomic_load(&sub->generation) != HANDLE_GENERATION(handle)
+    )
+        return -1;
+    return slot;
+}
+
+static TSubscriberHandle findHandle(TQueue *queue, pthread_t thread) {
+    if (queue->engine == ENGINE_RING)
+        return ringFindHandle(queue, thread);
+
+    TSubscriberHandle handle = 0;
+    queueLock(queue, LOCK_SITE_FIND_HANDLE);
+    for (int c = 0; c < queue->subscriberChunkCount && handle == 0; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1) {
+            int i = __builtin_ctzll(bits);
+            if (chunk->subs[i].threadId == thread) {
+                handle = HANDLE_MAKE(c * SUB_CHUNK_SIZE + i, chunk->subs[i].generation);
+                break;
+            }
+        }
+    }
+
+    // Slot lagged out and not reused since keeps its thread, old handle makes get report it
+    for (int c = 0; c < queue->subscriberChunkCount && handle == 0; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        for (uint64_t bits = ~chunk->active; bits != 0; bits &= bits - 1) {
+            int i = __builtin_ctzll(bits);
+            Subscriber *sub = &chunk->subs[i];
+            if (sub->laggedOut != 0 && sub->laggedOut + 1 == sub->generation && sub->threadId == thread) {
+                handle = HANDLE_MAKE(c * SUB_CHUNK_SIZE + i, sub->laggedOut);
+                break;
+            }
+        }
+    }
+    queueUnlock(queue);
+    return handle;
+}
+
+static TSubscriberHandle cachedHandle(TQueue *queue, pthread_t thread) {
+    uint32_t version = atomic_load(&queue->subscriptionsVersion);
+    if (
+        handleCache.queue == queue &&
+        handleCache.thread == thread &&
+        handleCache.version == version
+    )
+        return handleCache.handle;
+
+    TSubscriberHandle handle = findHandle(queue, thread);
+    handleCache.queue = queue;
+    handleCache.thread = thread;
+    handleCache.version = version;
+    handleCache.handle = handle;
+    return handle;
+}
+
+
+// -= Min cursor reclamation =-
+// RECLAIM_MIN_CURSOR queues keep no receivers counts, get only moves cursor of its own subscriber, so reads
+// never write to shared messages. Queue keeps the lowest cursor and number of subscribers on it,
+// messages before it were read by all. Lowest cursor is searched again only after its last subscriber
+// moved on, which happens at most once per freed message. All with mutex held.
+
+// Sequence of next message of subscriber, tail sequence for idle one
+static uint64_t subscriberCursor(TQueue *queue, Subscriber *sub) {
+    return sub->nextMsg != NULL ? sub->nextMsg->seq : atomic_load(&queue->tailSeq);
+}
+
+static void minCursorRecompute(TQueue *queue) {
+    uint64_t min = atomic_load(&queue->tailSeq);
+    int count = 0;
+    for (int c = 0; c < queue->subscriberChunkCount; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1) {
+            uint64_t cursor = subscriberCursor(queue, &chunk->subs[__builtin_ctzll(bits)]);
+            if (cursor < min) {
+                min = cursor;
+                count = 0;
+            }
+            if (cursor == min)
+                count++;
+        }
+    }
+    queue->minCursor = min;
+    queue->minCursorCount = count;
+}
+
+// New subscriber starts at tail, it is the lowest cursor only when queue has no unread messages
+static void cursorJoined(TQueue *queue, uint64_t cursor) {
+    if (queue->minCursorCount == 0)
+        queue->minCursor = cursor;
+    if (cursor == queue->minCursor)
+        queue->minCursorCount += 1;
+}
+
+// Subscriber moved from cursor by reading or unsubscribing, caller reclaims head afterwards
+static void cursorLeft(TQueue *queue, uint64_t cursor) {
+    if (cursor == queue->minCursor && --queue->minCursorCount == 0)
+        minCursorRecompute(queue);
+}
+
+
+
+// -= Hazard cursors =-
+// RECLAIM_HAZARD queues let get read without mutex. Cursor of subscriber is its hazard pointer: nodes from it
+// onward are never freed, and cursors only move forward. Reader owns the cursor while it reads (claimed),
+// mutex holders which move or clear it (drop of oldest message, unsubscribe, destroy) claim it too
+// and wait for reader inside, which never blocks. Read tail stays in cursor marked as passed,
+// so publisher never writes cursor of reading subscriber, only the NULL one of subscriber with nothing to read.
+// Removed messages keep their buffer until node is freed. Publishers free messages behind all cursors
+// when they need space, readers do it only when some publisher waits.
+
+#define CURSOR_PASSED ((uintptr_t)1) // Message nodes are cache line aligned, low bit is free
+
+static Message *cursorNode(Message *cursor) {
+    return (Message *)((uintptr_t)cursor & ~CURSOR_PASSED);
+}
+
+static bool cursorPassed(Message *cursor) {
+    return ((uintptr_t)cursor & CURSOR_PASSED) != 0;
+}
+
+static bool subscriberTryClaim(Subscriber *sub) {
+    int expected = 0;
+    return atomic_compare_exchange_strong(&sub->claimed, &expected, 1);
+}
+
+static void subscriberRelease(Subscriber *sub) {
+    atomic_store(&sub->claimed, 0);
+}
+
+// Claim of mutex holder, once exit flag is set destroy holds all claims, so cursor is owned already
+static void subscriberClaim(TQueue *queue, Subscriber *sub) {
+    while (!queue->exitFlag && !subscriberTryClaim(sub))
+        sched_yield();
+}
+
+static void subscriberUnclaim(TQueue *queue, Subscriber *sub) {
+    if (!queue->exitFlag)
+        subscriberRelease(sub);
+}
+
+// First unread message of subscriber, NULL if it read everything (mutex held)
+static Message *subscriberUnread(Subscriber *sub) {
+    Message *cursor = __atomic_load_n(&sub->nextMsg, __ATOMIC_ACQUIRE);
+    return cursorPassed(cursor) ? __atomic_load_n(&cursorNode(cursor)->next, __ATOMIC_ACQUIRE) : cursor;
+}
+
+// Frees messages passed by all subscribers (mutex held), returns number of freed messages
+// Space of message is given back once all passed it, its node once no cursor points to it,
+// which differs only for tail read by everybody. Cursor loaded before reader moves it keeps more messages.
+static int hazardReclaim(TQueue *queue) {
+    uint64_t minPassed = atomic_load(&queue->tailSeq);
+    uint64_t minPinned = minPassed;
+    for (int c = 0; c < queue->subscriberChunkCount; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1) {
+            Message *cursor = __atomic_load_n(&chunk->subs[__builtin_ctzll(bits)].nextMsg, __ATOMIC_SEQ_CST);
+            if (cursor == NULL)
+                continue;
+
+            uint64_t pinned = cursorNode(cursor)->seq;
+            uint64_t passed = pinned + (cursorPassed(cursor) ? 1 : 0);
+            if (pinned < minPinned)
+                minPinned = pinned;
+            if (passed < minPassed)
+                minPassed = passed;
+        }
+    }
+
+    int freed = 0;
+    for (Message *node = queue->head; node != NULL && node->seq < minPassed; node = node->next) {
+        if (node->seq >= queue->minCursor && node->length != MSG_REMOVED) {
+            queue->msgNumber -= 1;
+            freed++;
+        }
+    }
+    if (minPassed > queue->minCursor)
+        queue->minCursor = minPassed;
+
+    while (queue->head != NULL && queue->head->seq < minPinned) {
+        Message *tmp = queue->head;
+        queue->head = tmp->next;
+        if (queue->tail == tmp) {
+            queue->tail = NULL;
+        }
+        poolFree(queue, tmp);
+    }
+    return freed;
+}
+
+
+
+// -= Supportive functions =-
+// Frees messages from head which were read by all receivers, returns number of freed messages
+// Receivers counts never grow towards tail, so only head can be the first fully read message,
+// same holds for messages before the lowest cursor
+// Removed messages gave their space back already, they are freed but not counted
+static bool headRead(TQueue *queue) {
+    if (queue->reclaim == RECLAIM_MIN_CURSOR)
+        return queue->head->seq < queue->minCursor;
+    return queue->head->receivers == 0;
+}
+
+static int reclaimHead(TQueue *queue) {
+    int freed = 0;
+    while (queue->head != NULL && headRead(queue)) {
+        Message *tmp = queue->head;
+        queue->head = tmp->next;
+        if (queue->tail == tmp) {
+            queue->tail = NULL;
+        }
+        if (tmp->length != MSG_REMOVED) {
+            queue->msgNumber -= 1;
+            freed++;
+        }
+        poolFree(queue, tmp);
+    }
+    return freed;
+}
+
+
+// Wakes publishers waiting for space, only if some space was freed
+static void wakePublishers(TQueue *queue, int freed) {
+    if (freed == 0 || queue->waitingPublishers == 0)
+        return;
+
+    if (freed == 1)
+        pthread_cond_signal(&queue->msgPutCall);
+    else
+        pthread_cond_broadcast(&queue->msgPutCall);
+}
+
+// Unread messages of subscriber, exact with mutex held, lock-free estimate otherwise
+static int subscriberAvailable(TQueue *queue, Subscriber *sub) {
+    return (int)(atomic_load(&queue->tailSeq) - atomic_load(&sub->readSeq) - atomic_load(&sub->skipped));
+}
+
+// Absolute CLOCK_MONOTONIC time 0 has always passed, used by try variants
+static const struct timespec noWait = { 0, 0 };
+
+static bool deadlinePassed(const struct timespec *deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+// One busy-wait step of queue wait strategy (shared with ring engine)
+// Returns false when caller should park instead
+bool waitBackoff(TQueue *queue, int *spins) {
+    switch (queue->waitStrategy) {
+        case WAIT_SPIN:
+            cpuRelax();
+            return true;
+        case WAIT_SPIN_YIELD:
+            if ((*spins)++ < queue->spinLimit)
+                cpuRelax();
+            else
+                sched_yield();
+            return true;
+        case WAIT_SPIN_PARK:
+            if ((*spins)++ < queue->spinLimit) {
+                cpuRelax();
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+// Spins without mutex until subscriber has minCount unread messages
+// Returns true if strategy gave up and caller should park
+static bool spinForMessages(TQueue *queue, TSubscriberHandle handle, int minCount, const struct timespec *deadline) {
+    Subscriber *sub = subscriberAt(queue, HANDLE_SLOT(handle));
+    int spins = 0;
+    while (subscriberAvailable(queue, sub) < minCount) {
+        if (
+            queue->exitFlag ||
+            atomic_load(&sub->generation) != HANDLE_GENERATION(handle) ||
+            (deadline != NULL && deadlinePassed(deadline))
+        )
+            return false;
+        if (!waitBackoff(queue, &spins))
+            return true;
+    }
+    return false;
+}
+
+// Spins without mutex until queue has free space, returns true if caller should park
+static bool spinForSpace(TQueue *queue, const struct timespec *deadline) {
+    int spins = 0;
+    while (queue->msgNumber >= queue->msgMax) {
+        if (queue->exitFlag || queue->overflowPolicy != OVERFLOW_BLOCK || (deadline != NULL && deadlinePassed(deadline)))
+            return false;
+        if (!waitBackoff(queue, &spins))
+            return true;
+    }
+    return false;
+}
+
+// Message returned to subscribers as pointer (putI or putPayloadI)
+static bool messageIsPointer(Message *node) {
+    return node->length == MSG_POINTER || node->length == MSG_PAYLOAD;
+}
+
+// Only pointer messages can be removed by pointer, inline payload would overlap msg
+static bool messageIs(Message *node, void *msg) {
+    return messageIsPointer(node) && node->msg == msg;
+}
+
+// RECLAIM_HAZARD keeps messages read by all linked until space is needed, after hazardReclaim
+// those still pinned by cursors are below minCursor, removal must not find them (mutex held)
+static bool messageReadByAll(TQueue *queue, Message *node) {
+    return queue->reclaim == RECLAIM_HAZARD && node->seq < queue->minCursor;
+}
+
+// Frees RECLAIM_HAZARD messages read by all before removal looks for message (mutex held)
+static void reclaimBeforeRemove(TQueue *queue) {
+    if (queue->reclaim == RECLAIM_HAZARD)
+        wakePublishers(queue, hazardReclaim(queue));
+}
+
+// Claims RECLAIM_HAZARD subscribers which did not read past seq yet, so none of them passes message while
+// it changes, the others can not reach it any more (mutex held)
+static void claimReaders(TQueue *queue, uint64_t seq) {
+    for (int c = 0; c < queue->subscriberChunkCount; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1) {
+            Subscriber *sub = &chunk->subs[__builtin_ctzll(bits)];
+            if (atomic_load(&sub->readSeq) > seq)
+                continue;
+            subscriberClaim(queue, sub);
+            // Reader which held the claim may have passed it meanwhile
+            if (atomic_load(&sub->readSeq) > seq)
+                subscriberUnclaim(queue, sub);
+        }
+    }
+}
+
+// Counts removed message as skipped for subscribers which did not reach it, so getAvailableI stays
+// a subtraction, reader takes it back when it passes the tombstone (mutex held)
+// Releases claims of claimReaders, claimed are exactly those which did not reach it
+static void skipRemoved(TQueue *queue, Message *node) {
+    for (int c = 0; c < queue->subscriberChunkCount; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1) {
+            Subscriber *sub = &chunk->subs[__builtin_ctzll(bits)];
+            if (atomic_load(&sub->readSeq) > node->seq)
+                continue;
+            atomic_fetch_add(&sub->skipped, 1);
+            if (queue->reclaim == RECLAIM_HAZARD)
+                subscriberUnclaim(queue, sub);
+        }
+    }
+}
+
+// Unlinks tombstones, so subscriber which does not read while messages are removed does not grow the pool
+// (mutex held). Cursors on tombstone move to the next message, they counted it in skipped already
+// and take it back from the sequence gap. Tail stays, RECLAIM_HAZARD passed cursor finds new messages through it.
+// RECLAIM_HAZARD readers walk nodes after their cursor, so all of them are claimed
+static void compactRemoved(TQueue *queue) {
+    bool isHazard = queue->reclaim == RECLAIM_HAZARD;
+    for (int c = 0; c < queue->subscriberChunkCount; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1) {
+            Subscriber *sub = &chunk->subs[__builtin_ctzll(bits)];
+            if (isHazard)
+                subscriberClaim(queue, sub);
+            Message *cursor = sub->nextMsg;
+            Message *node = cursorNode(cursor);
+            if (node == NULL || node->length != MSG_REMOVED || (cursorPassed(cursor) && node->next == NULL))
+                continue;
+
+            if (cursorPassed(cursor))
+                node = node->next;
+            while (node->length == MSG_REMOVED && node->next != NULL)
+                node = node->next;
+            __atomic_store_n(&sub->nextMsg, node, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    Message *prev = NULL;
+    for (Message *node = queue->head; node != NULL;) {
+        Message *next = node->next;
+        if (node->length == MSG_REMOVED && next != NULL) {
+            if (prev == NULL)
+                queue->head = next;
+            else
+                __atomic_store_n(&prev->next, next, __ATOMIC_RELEASE);
+            poolFree(queue, node);
+        } else {
+            prev = node;
+        }
+        node = next;
+    }
+
+    if (isHazard) {
+        for (int c = 0; c < queue->subscriberChunkCount; c++) {
+            SubscriberChunk *chunk = queue->subscriberChunks[c];
+            for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1)
+                subscriberUnclaim(queue, &chunk->subs[__builtin_ctzll(bits)]);
+        }
+    }
+    // Cursors moved to later sequences
+    if (queue->reclaim == RECLAIM_MIN_CURSOR)
+        minCursorRecompute(queue);
+}
+
+// Removes message with one visit of subscribers (mutex held): payload is dropped and space returned
+// right away, node stays in list as tombstone, subscribers skip it when they reach it and the last one reclaims it
+// Once more than msgMax tombstones are linked, all but tail are unlinked (compactRemoved, O(depth) each msgMax removals)
+static void removeMessage(TQueue *queue, Message *node) {
+    if (queue->reclaim == RECLAIM_HAZARD) {
+        claimReaders(queue, node->seq);
+        // Lock-free reader may be copying it, buffer is freed with the node, its length is kept in receivers
+        node->receivers = node->length;
+        __atomic_store_n(&node->length, MSG_REMOVED, __ATOMIC_RELEASE);
+        if (node->seq >= queue->minCursor) {
+            queue->msgNumber -= 1;
+            wakePublishers(queue, 1);
+        }
+    } else {
+        if (node->length > MSG_INLINE_SIZE)
+            bufferFree(queue, node->msg, node->length);
+        else if (node->length == MSG_PAYLOAD)
+            payloadDrop(queue, node->msg);
+        node->length = MSG_REMOVED;
+        node->msg = NULL;
+
+        queue->msgNumber -= 1;
+        wakePublishers(queue, 1);
+    }
+    skipRemoved(queue, node);
+
+    queue->removedNodes += 1;
+    if (queue->removedNodes > queue->msgMax)
+        compactRemoved(queue);
+}
+
+// Counts message dropped before subscriber read it, so getAvailableI stays a subtraction
+// Tombstone was counted by removeMessage already
+static void skipForSubscriber(Subscriber *sub, Message *removed) {
+    if (removed->length != MSG_REMOVED && sub->nextMsg != NULL && sub->nextMsg->seq <= removed->seq)
+        atomic_fetch_add(&sub->skipped, 1);
+}
+
+
+// Moves claimed cursor off message which is being dropped, message was skipped unless cursor passed it
+static void dropForHazard(TQueue *queue, int slot, Message *removed, Message *next) {
+    Subscriber *sub = subscriberAt(queue, slot);
+    if (cursorNode(__atomic_load_n(&sub->nextMsg, __ATOMIC_ACQUIRE)) != removed)
+        return;
+
+    // Reader which held the claim may have moved the cursor meanwhile
+    subscriberClaim(queue, sub);
+    Message *cursor = sub->nextMsg;
+    if (cursorNode(cursor) == removed) {
+        if (!cursorPassed(cursor) && removed->length != MSG_REMOVED)
+            atomic_fetch_add(&sub->skipped, 1);
+        __atomic_store_n(&sub->nextMsg, next, __ATOMIC_SEQ_CST);
+        if (next == NULL)
+            setIdle(queue, slot, true);
+    }
+    subscriberUnclaim(queue, sub);
+}
+
+// Moves subscribers off message which is being dropped, those left without message become idle
+static void dropForSubscribers(TQueue *queue, Message *removed, Message *next) {
+    for (int c = 0; c < queue->subscriberChunkCount; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1) {
+            int i = __builtin_ctzll(bits);
+            Subscriber *sub = &chunk->subs[i];
+            if (queue->reclaim == RECLAIM_HAZARD) {
+                dropForHazard(queue, c * SUB_CHUNK_SIZE + i, removed, next);
+                continue;
+            }
+            skipForSubscriber(sub, removed);
+            if (sub->nextMsg == removed) {
+                sub->nextMsg = next;
+                if (next == NULL)
+                    setIdle(queue, c * SUB_CHUNK_SIZE + i, true);
+            }
+        }
+    }
+}
+
+// Drops oldest message whether it was read or not (mutex held, head must not be NULL)
+// Returns false for removed message, which held no space, and for RECLAIM_HAZARD tail read by all
+static bool dropHead(TQueue *queue) {
+    Message *tmp = queue->head;
+    dropForSubscribers(queue, tmp, tmp->next);
+
+    queue->head = tmp->next;
+    if (queue->tail == tmp) {
+        queue->tail = NULL;
+    }
+    bool isMessage = tmp->length != MSG_REMOVED && (queue->reclaim != RECLAIM_HAZARD || tmp->seq >= queue->minCursor);
+    if (isMessage)
+        queue->msgNumber -= 1;
+    poolFree(queue, tmp);
+    // Head was the lowest cursor, its subscribers moved to the next message or became idle
+    if (queue->reclaim == RECLAIM_MIN_CURSOR)
+        minCursorRecompute(queue);
+    return isMessage;
+}
+
+// Frees slot of valid handle (mutex held), caller drops receivers of its unread messages
+static void releaseSlot(TQueue *queue, int slot) {
+    Subscriber *sub = subscriberAt(queue, slot);
+    queue->subscribersNumber -= 1;
+    atomic_fetch_add(&queue->subscriptionsVersion, 1);
+
+    // Remove from subscribers list, waiters bit stays until waiting thread leaves
+    // Lock-free get checks generation after it claims the cursor
+    atomic_fetch_add(&sub->generation, 1);
+    sub->threadId = -1;
+    if (queue->reclaim == RECLAIM_HAZARD)
+        subscriberClaim(queue, sub);
+    __atomic_store_n(&sub->nextMsg, NULL, __ATOMIC_SEQ_CST);
+    if (queue->reclaim == RECLAIM_HAZARD)
+        subscriberUnclaim(queue, sub);
+    queue->subscriberChunks[slot / SUB_CHUNK_SIZE]->active &= ~(1ull << (slot % SUB_CHUNK_SIZE));
+    setIdle(queue, slot, false);
+
+    // Wake thread if it waits in getI, so it notices unsubscription
+    pthread_cond_broadcast(&sub->msgGetCall);
+}
+
+// Unsubscribes valid slot (mutex held), its unread messages lose one receiver
+// Returns number of messages freed because of it
+static int detachSubscriber(TQueue *queue, int slot) {
+    if (queue->reclaim == RECLAIM_HAZARD) {
+        releaseSlot(queue, slot);
+        return hazardReclaim(queue);
+    }
+    if (queue->reclaim == RECLAIM_MIN_CURSOR) {
+        uint64_t cursor = subscriberCursor(queue, subscriberAt(queue, slot));
+        releaseSlot(queue, slot);
+        cursorLeft(queue, cursor);
+        return reclaimHead(queue);
+    }
+
+    // Get its last message
+    Message *threadNextMsg = subscriberAt(queue, slot)->nextMsg;
+    releaseSlot(queue, slot);
+
+    // If thread has unread messages then decrement receivers starting from newest unread
+    for (Message *tmp = threadNextMsg; tmp != NULL; tmp = tmp->next) {
+        tmp->receivers -= 1;
+    }
+
+    // Delete messages with no receivers
+    return reclaimHead(queue);
+}
+
+// Slot of subscriber with the lowest read sequence, -1 if there is none (mutex held)
+static int slowestSubscriber(TQueue *queue) {
+    int slowest = -1;
+    uint64_t slowestSeq = UINT64_MAX;
+    for (int c = 0; c < queue->subscriberChunkCount; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1) {
+            int i = __builtin_ctzll(bits);
+            Message *unread = subscriberUnread(&chunk->subs[i]);
+            if (unread != NULL && unread->seq < slowestSeq) {
+                slowestSeq = unread->seq;
+                slowest = c * SUB_CHUNK_SIZE + i;
+            }
+        }
+    }
+    return slowest;
+}
+
+
+
+// -= Statistics =-
+// Every thread counts into its own cache line slot of queue, slots are assigned round robin at first use.
+// Counters are added without mutex, so threads sharing slot (more than STATS_SLOTS) still count exactly,
+// but the hot path writes nothing other threads read. getQueueStatsI sums the slots.
+
+static _Atomic int statsThreads;
+static __thread int statsSlot = -1;
+
+// Slot of calling thread (shared with ring engine)
+TQueueThreadStats *threadStats(TQueue *queue) {
+    if (statsSlot == -1)
+        statsSlot = atomic_fetch_add_explicit(&statsThreads, 1, memory_order_relaxed) & (STATS_SLOTS - 1);
+    return &queue->stats[statsSlot];
+}
+
+void statsAdd(_Atomic uint64_t *counter, uint64_t value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+void statsDepth(TQueue *queue, uint64_t depth) {
+    TQueueThreadStats *stats = threadStats(queue);
+    if (depth > atomic_load_explicit(&stats->depthHighWater, memory_order_relaxed))
+        atomic_store_explicit(&stats->depthHighWater, depth, memory_order_relaxed);
+}
+
+// Adds unread messages of one subscriber to snapshot (shared with ring engine)
+void statsLag(TQueueStats *stats, TSubscriberHandle handle, uint64_t lag) {
+    if (stats->subscribers == 0 || lag > stats->maxSubscriberLag) {
+        stats->maxSubscriberLag = lag;
+        stats->slowestSubscriber = handle;
+    }
+    stats->subscribers += 1;
+    stats->totalSubscriberLag += lag;
+}
+
+// Counts wait of put or get which started blocking at since (0 - call did not block)
+void statsBlocked(TQueue *queue, bool isPut, uint64_t since) {
+    if (since == 0)
+        return;
+
+    TQueueThreadStats *stats = threadStats(queue);
+    statsAdd(isPut ? &stats->blockedPuts : &stats->blockedGets, 1);
+    statsAdd(&stats->blockedNs, monotonicNs() - since);
+}
+
+
+// -= Latency tracing =-
+// Traced queue stamps messages when they are enqueued, get adds time from the stamp to its read into histogram
+// of subscriber, one clock read per put and per get call. Histograms are written with mutex held.
+
+// Lowest value of bucket
+static uint64_t traceValue(int index) {
+    if (index < (1 << TRACE_SUB_BITS))
+        return index;
+
+    int shift = (index >> TRACE_SUB_BITS) - 1;
+    return (uint64_t)((1 << TRACE_SUB_BITS) + (index & ((1 << TRACE_SUB_BITS) - 1))) << shift;
+}
+
+#ifdef PUBSUB_TRACING
+static int traceIndex(uint64_t ns) {
+    if (ns < (1u << TRACE_SUB_BITS))
+        return (int)ns;
+
+    int shift = 63 - __builtin_clzll(ns) - TRACE_SUB_BITS;
+    int index = ((shift + 1) << TRACE_SUB_BITS) + (int)((ns >> shift) & ((1u << TRACE_SUB_BITS) - 1));
+    return index < TRACE_BUCKETS ? index : TRACE_BUCKETS - 1;
+}
+
+static void traceRecord(TLatencyHistogram *histogram, uint64_t ns) {
+    histogram->counts[traceIndex(ns)]++;
+    histogram->total++;
+    if (ns > histogram->max)
+        histogram->max = ns;
+}
+
+// Gives subscriber of traced queue empty histogram, slot keeps it for later subscribers (mutex held)
+static void traceAttach(TQueue *queue, Subscriber *sub) {
+    if (!queue->tracing)
+        return;
+
+    if (sub->latency == NULL)
+        sub->latency = malloc(sizeof(TLatencyHistogram));
+    if (sub->latency == NULL) {
+        LOG_ERROR("[S] - Failed to allocate latency histogram | Subscriber not traced\n");
+        return;
+    }
+    memset(sub->latency, 0, sizeof(TLatencyHistogram));
+}
+#endif
+
+
+// -= Lag limit =-
+// Subscriber which falls more than maxLag messages behind tail, or keeps unread messages for maxLagNs without
+// reading them, is unsubscribed by publisher, so dead subscriber does not pin messages and space of the others.
+// Checks run with mutex held, when messages are enqueued and while publisher waits for space.
+
+static bool subscriberLagging(TQueue *queue, Subscriber *sub, uint64_t tailSeq, uint64_t now) {
+    Message *unread = subscriberUnread(sub);
+    if (unread == NULL)
+        return false;
+    if (queue->maxLag > 0 && tailSeq - unread->seq > (uint64_t)queue->maxLag)
+        return true;
+    if (queue->maxLagNs == 0)
+        return false;
+
+    // Lock-free get of RECLAIM_HAZARD queue updates it without mutex, caught up reader stopped the clock
+    // and put does not visit it, so clock starts at the first check which finds unread messages
+    uint64_t since = __atomic_load_n(&sub->lagSinceNs, __ATOMIC_RELAXED);
+    if (since == 0) {
+        __atomic_compare_exchange_n(&sub->lagSinceNs, &since, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        return false;
+    }
+    return now - since > queue->maxLagNs;
+}
+
+// Drops one receiver per detached subscriber from its first unread message to tail,
+// one walk serves all of them, positions are sorted in place
+static void dropReceivers(Message **positions, int count) {
+    for (int i = 1; i < count; i++) {
+        Message *position = positions[i];
+        int j = i;
+        for (; j > 0 && positions[j - 1]->seq > position->seq; j--) {
+            positions[j] = positions[j - 1];
+        }
+        positions[j] = position;
+    }
+
+    int passed = 0;
+    for (Message *node = positions[0]; node != NULL; node = node->next) {
+        while (passed < count && positions[passed] == node)
+            passed++;
+        node->receivers -= passed;
+    }
+}
+
+// Unsubscribes all lagging subscribers in bulk, one list walk per subscriber chunk
+// Their handles get lagged out status, returns number of freed messages
+static int detachLagging(TQueue *queue, uint64_t tailSeq, uint64_t now) {
+    int detached = 0;
+    for (int c = 0; c < queue->subscriberChunkCount; c++) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        Message *positions[SUB_CHUNK_SIZE];
+        int count = 0;
+        for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1) {
+            int i = __builtin_ctzll(bits);
+            Subscriber *sub = &chunk->subs[i];
+            if (!subscriberLagging(queue, sub, tailSeq, now))
+                continue;
+
+            positions[count++] = sub->nextMsg;
+            sub->laggedOut = atomic_load(&sub->generation);
+            pthread_t thread = sub->threadId;
+            releaseSlot(queue, c * SUB_CHUNK_SIZE + i);
+            // Kept for pthread_t interfaces, see findHandle
+            sub->threadId = thread;
+        }
+        if (count > 0 && queue->reclaim == RECLAIM_RECEIVERS)
+            dropReceivers(positions, count);
+        detached += count;
+    }
+
+    if (detached == 0)
+        return 0;
+    if (queue->reclaim == RECLAIM_MIN_CURSOR)
+        minCursorRecompute(queue);
+    queue->overflowStats.laggedOutSubscribers += detached;
+    LOG_INFO("[U] - Subscribers lagged out | Unsubscribed %d\n", detached);
+    return queue->reclaim == RECLAIM_HAZARD ? hazardReclaim(queue) : reclaimHead(queue);
+}
+
+// Detaches lagging subscribers if lag limit may be exceeded, now is needed only with maxLagNs
+// Lag is measured against tailSeq given by caller, so messages being put do not count
+// Oldest message far behind tail means some subscriber did not read it, otherwise nobody lags
+// RECLAIM_HAZARD head keeps messages read by all until space is needed, there minCursor is lowest
+// unread sequence as of last cursor scan, cursors are scanned again only when even that shows lag
+// Returns number of freed messages
+static int checkLag(TQueue *queue, uint64_t tailSeq, uint64_t now) {
+    if (queue->maxLagNs > 0 && now >= queue->lagCheckNs) {
+        queue->lagCheckNs = now + queue->maxLagNs / 2;
+        return detachLagging(queue, tailSeq, now);
+    }
+    if (queue->maxLag == 0 || queue->head == NULL)
+        return 0;
+    if (queue->reclaim != RECLAIM_HAZARD)
+        return tailSeq - queue->head->seq > (uint64_t)queue->maxLag ? detachLagging(queue, tailSeq, now) : 0;
+
+    // minCursor may be past tailSeq of caller, chain being put is already counted in queue tailSeq
+    if ((int64_t)(tailSeq - queue->minCursor) <= queue->maxLag)
+        return 0;
+    int freed = hazardReclaim(queue);
+    if ((int64_t)(tailSeq - queue->minCursor) <= queue->maxLag)
+        return freed;
+    return freed + detachLagging(queue, tailSeq, now);
+}
+
+// Status of get with handle which is no longer valid (mutex held)
+static int unsubscribedStatus(TQueue *queue, TSubscriberHandle handle) {
+    Subscriber *sub = subscriberAt(queue, HANDLE_SLOT(handle));
+    if (handle != 0 && sub != NULL && sub->laggedOut == HANDLE_GENERATION(handle))
+        return GET_LAGGED_OUT;
+    return -1;
+}
 
 
 // -= Interfaces =-
-void createQueueI(TQueue *queue, int size) {
+// Returns false if engine storage could not be allocated, config NULL means default list engine
+bool createQueueConfigI(TQueue *queue, int size, const TQueueConfig *config) {
+    // Deadlines of timed calls are measured on monotonic clock
+    pthread_condattr_t monotonic;
+    pthread_condattr_init(&monotonic);
+    pthread_condattr_setclock(&monotonic, CLOCK_MONOTONIC);
+
     pthread_mutex_init(&queue->mutex, NULL);
     pthread_cond_init(&queue->msgGetCall, NULL);
-    pthread_cond_init(&queue->msgPutCall, NULL);
-
+    pthread_cond_init(&queue->msgPutCall, &monotonic);
+
+    queue->engine = config != NULL ? config->engine : ENGINE_LIST;
+    queue->waitStrategy = config != NULL ? config->wait : WAIT_DEFAULT;
+    if (queue->waitStrategy == WAIT_DEFAULT)
+        queue->waitStrategy = queue->engine == ENGINE_RING ? WAIT_SPIN_PARK : WAIT_PARK;
+    queue->spinLimit = config != NULL && config->spinLimit > 0 ? config->spinLimit : WAIT_SPIN_LIMIT;
+    queue->overflowPolicy = config != NULL ? config->overflow : OVERFLOW_BLOCK;
+    if (queue->engine == ENGINE_RING && queue->overflowPolicy != OVERFLOW_BLOCK) {
+        LOG_ERROR("[Q] - Ring engine supports only blocking overflow | Using block\n");
+        queue->overflowPolicy = OVERFLOW_BLOCK;
+    }
+    queue->ring = NULL;
     queue->head = NULL;
     queue->tail = NULL;
+    atomic_init(&queue->tailSeq, 0);
+    queue->freeNodes = NULL;
+    queue->chunks = NULL;
+    queue->poolSize = 0;
+    memset(queue->freeBuffers, 0, sizeof(queue->freeBuffers));
+    queue->releasedPayloads = NULL;
+    memset(&queue->overflowStats, 0, sizeof(queue->overflowStats));
+    memset(queue->stats, 0, sizeof(queue->stats));
+#ifdef PUBSUB_LOCK_PROFILE
+    memset(queue->lockProfile, 0, sizeof(queue->lockProfile));
+#endif
+    queue->maxLag = config != NULL ? config->maxLag : 0;
+    queue->maxLagNs = config != NULL ? config->maxLagNs : 0;
+    queue->lagCheckNs = 0;
+    if (queue->engine == ENGINE_RING && (queue->maxLag > 0 || queue->maxLagNs > 0)) {
+        LOG_ERROR("[Q] - Ring engine does not support lag limit | Limit ignored\n");
+        queue->maxLag = 0;
+        queue->maxLagNs = 0;
+    }
+#ifdef PUBSUB_TRACING
+    queue->tracing = config != NULL && config->tracing;
+    if (queue->engine == ENGINE_RING && queue->tracing) {
+        LOG_ERROR("[Q] - Ring engine does not support tracing | Tracing disabled\n");
+        queue->tracing = false;
+    }
+#else
+    if (config != NULL && config->tracing)
+        LOG_ERROR("[Q] - Tracing needs build with -DPUBSUB_TRACING | Tracing disabled\n");
+#endif
+    queue->reclaim = config != NULL ? config->reclaim : RECLAIM_RECEIVERS;
+    queue->minCursor = 0;
+    queue->minCursorCount = 0;
+    atomic_init(&queue->reclaimingReaders, 0);
     queue->msgMax = size;
     queue->msgNumber = 0;
+    queue->removedNodes = 0;
     queue->exitFlag = false;
     queue->exitMode = 0;
     queue->activePublishers = 0;
     queue->activeSubscribers = 0;
+    queue->waitingPublishers = 0;
 
     // Empty subscribers list
     queue->subscribersNumber = 0;
-    for (int i = 0; i < MAX_SUBS; i++) {
-        queue->subscribers[i].threadId = -1;
-        queue->subscribers[i].nextMsg = NULL;
+    atomic_init(&queue->subscriptionsVersion, atomic_fetch_add(&versionSeed, 1u << 16));
+    for (int c = 0; c < SUB_CHUNKS_MAX; c++) {
+        atomic_init(&queue->subscriberChunks[c], NULL);
+    }
+    queue->subscriberChunkCount = 0;
+    memset(queue->notifyChunks, 0, sizeof(queue->notifyChunks));
+    pthread_condattr_destroy(&monotonic);
+
+    if (queue->engine == ENGINE_RING && !ringCreate(queue, size, config->ringCapacity)) {
+        LOG_ERROR("[Q] - Failed to allocate ring | Queue not initialized\n");
+        return false;
+    }
+
+    if (queue->engine == ENGINE_LIST && (!poolGrow(queue, size) || !subscriberChunkAdd(queue))) {
+        LOG_ERROR("[Q] - Failed to allocate message pool or subscriber table | Queue not initialized\n");
+        return false;
+    }
+
+    LOG_INFO("[Q] - Queue initialized\n");
+    return true;
+}
+
+void createQueueI(TQueue *queue, int size) {
+    createQueueConfigI(queue, size, NULL);
+}
+
+void destroyQueueI(TQueue *queue) {
+    if (queue->engine == ENGINE_RING) {
+        LOG_INFO("[D] - Preparation for destroying queue\n");
+        ringDestroy(queue);
+        pthread_cond_destroy(&queue->msgGetCall);
+        pthread_cond_destroy(&queue->msgPutCall);
+        pthread_mutex_destroy(&queue->mutex);
+        free(queue);
+        LOG_INFO("[D] - Queue destroyed\n");
+        return;
+    }
+
+    LOG_INFO("[D] - Preparation for destroying queue\n");
+    queueLock(queue, LOCK_SITE_DESTROY);
+
+    queue->exitFlag = true;
+    // Lock-free gets check exit flag after they claim cursor, claims are kept until queue is freed
+    if (queue->reclaim == RECLAIM_HAZARD) {
+        for (int c = 0; c < queue->subscriberChunkCount; c++) {
+            for (int i = 0; i < SUB_CHUNK_SIZE; i++) {
+                while (!subscriberTryClaim(&queue->subscriberChunks[c]->subs[i]))
+                    sched_yield();
+            }
+        }
+        while (atomic_load(&queue->reclaimingReaders) != 0) {
+            queueUnlock(queue);
+            sched_yield();
+            queueLock(queue, LOCK_SITE_DESTROY);
+        }
+    }
+
+    // Wait for all "waiting on condition" threads
+    // Using repetitive calls while normal putI & getI methods pass
+    // 1. publishers
+    queue->exitMode = 1;
+    while (queue->activePublishers != 0) {
+        pthread_cond_broadcast(&queue->msgPutCall);
+        queueWait(queue, &queue->msgPutCall, NULL);
+    }
+    LOG_INFO("[D] - Removed all waiting publishers\n");
+
+    // 2. subscribers, each waits on condition variable of its slot, leaving ones signal msgGetCall
+    queue->exitMode = 2;
+    while (queue->activeSubscribers != 0) {
+        for (int c = 0; c < queue->subscriberChunkCount; c++) {
+            SubscriberChunk *chunk = queue->subscriberChunks[c];
+            for (int i = 0; i < SUB_CHUNK_SIZE; i++) {
+                pthread_cond_broadcast(&chunk->subs[i].msgGetCall);
+            }
+        }
+        queueWait(queue, &queue->msgGetCall, NULL);
+    }
+    LOG_INFO("[D] - Removed all waiting subscribers\n");
+
+    // Clear all Messages structures, unread ones may own payload buffer
+    Message *tmp = queue->head;
+    while (tmp != NULL) {
+        queue->head = tmp->next;
+        poolFree(queue, tmp);
+        tmp = queue->head;
+    }
+    poolDestroy(queue);
+    bufferPoolDestroy(queue);
+    TPayload *released = payloadsTake(queue);
+
+    // Clear rest of the TQueue structure
+    queueUnlock(queue);
+    payloadsRelease(released);
+    subscriberChunksDestroy(queue);
+    pthread_cond_destroy(&queue->msgGetCall);
+    pthread_cond_destroy(&queue->msgPutCall);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+
+    LOG_INFO("[D] - Queue destroyed\n");
+}
+
+// Returns handle of new subscriber, 0 if there is no free slot
+TSubscriberHandle subscribeI(TQueue *queue, pthread_t thread) {
+    if (queue->engine == ENGINE_RING)
+        return ringSubscribe(queue, thread);
+
+    queueLock(queue, LOCK_SITE_SUBSCRIBE);
+    // Lowest free slot, table grows by one chunk when all are taken
+    int c = 0;
+    while (c < queue->subscriberChunkCount && ~queue->subscriberChunks[c]->active == 0)
+        c++;
+
+    if (c < queue->subscriberChunkCount || subscriberChunkAdd(queue)) {
+        SubscriberChunk *chunk = queue->subscriberChunks[c];
+        int i = __builtin_ctzll(~chunk->active);
+        int slot = c * SUB_CHUNK_SIZE + i;
+        Subscriber *sub = &chunk->subs[i];
+
+        // Hazard cursor starts on tail passed, so publisher does not need to hand it next message
+        sub->threadId = thread;
+        sub->nextMsg = NULL;
+        if (queue->reclaim == RECLAIM_HAZARD && queue->tail != NULL)
+            sub->nextMsg = (Message *)((uintptr_t)queue->tail | CURSOR_PASSED);
+        atomic_store(&sub->readSeq, atomic_load(&queue->tailSeq));
+        atomic_store(&sub->skipped, 0);
+        uint32_t generation = atomic_fetch_add(&sub->generation, 1) + 1;
+        chunk->active |= 1ull << i;
+        setIdle(queue, slot, sub->nextMsg == NULL);
+#ifdef PUBSUB_TRACING
+        traceAttach(queue, sub);
+#endif
+
+        if (queue->reclaim == RECLAIM_MIN_CURSOR)
+            cursorJoined(queue, atomic_load(&queue->tailSeq));
+
+        queue->subscribersNumber += 1;
+        atomic_fetch_add(&queue->subscriptionsVersion, 1);
+        TSubscriberHandle handle = HANDLE_MAKE(slot, generation);
+        queueUnlock(queue);
+        LOG_INFO("[S] - Thread subscribed to queue\n");
+        return handle;
+    }
+    queueUnlock(queue);
+    LOG_ERROR("[S] - Thread failed while subscribing to queue\n");
+    return 0;
+}
+
+void unsubscribeByHandleI(TQueue *queue, TSubscriberHandle handle) {
+    if (queue->engine == ENGINE_RING) {
+        ringUnsubscribe(queue, handle);
+        return;
+    }
+
+    queueLock(queue, LOCK_SITE_UNSUBSCRIBE);
+    int freed = 0;
+    int threadSubId = handleSlot(queue, handle);
+    if (threadSubId != -1)
+        freed = detachSubscriber(queue, threadSubId);
+    wakePublishers(queue, freed);
+    TPayload *released = payloadsTake(queue);
+    queueUnlock(queue);
+    payloadsRelease(released);
+
+    if (freed > 0) {
+        LOG_DEBUG("[U] - Found empty message | Deleting message\n");
+    }
+}
+
+void unsubscribeI(TQueue *queue, pthread_t thread) {
+    unsubscribeByHandleI(queue, cachedHandle(queue, thread));
+}
+
+// Notices queue destroy procedure and its status (mode), called right after locking
+// Returns true if queue is being destroyed, mutex is then unlocked
+static bool leaveOnExit(TQueue *queue) {
+    if (!queue->exitFlag)
+        return false;
+
+    int exitMode = queue->exitMode;
+    queueUnlock(queue);
+
+    if (exitMode == 1)
+        pthread_cond_broadcast(&queue->msgPutCall);
+    else if (exitMode == 2)
+        pthread_cond_broadcast(&queue->msgGetCall);
+    return true;
+}
+
+// Makes space for needed messages according to overflow policy (mutex held)
+// Subscribers are evicted only until one message fits
+// Returns false when policy can not make any, caller then waits like with OVERFLOW_BLOCK
+static bool overflowMakeSpace(TQueue *queue, int needed) {
+    if (needed > queue->msgMax)
+        needed = queue->msgMax;
+    if (queue->overflowPolicy == OVERFLOW_EVICT_SLOWEST)
+        needed = 1;
+
+    // Reserved messages are not linked yet, list may run out before space is made
+    while (queue->msgMax - queue->msgNumber < needed && queue->head != NULL) {
+        if (queue->overflowPolicy == OVERFLOW_DROP_OLDEST) {
+            if (dropHead(queue))
+                queue->overflowStats.droppedOldest += 1;
+        } else {
+            int slot = slowestSubscriber(queue);
+            if (slot == -1)
+                break;
+            detachSubscriber(queue, slot);
+            queue->overflowStats.evictedSubscribers += 1;
+            LOG_INFO("[U] - Queue full | Evicted slowest subscriber\n");
+        }
+    }
+    return queue->msgNumber < queue->msgMax;
+}
+
+// OVERFLOW_DROP_NEWEST check of put (mutex held), returns true if count messages were dropped
+static bool overflowDropNewest(TQueue *queue, int count) {
+    if (queue->overflowPolicy != OVERFLOW_DROP_NEWEST)
+        return false;
+    // Read messages of RECLAIM_HAZARD queue are freed before new ones are dropped
+    if (queue->reclaim == RECLAIM_HAZARD && queue->msgNumber >= queue->msgMax)
+        hazardReclaim(queue);
+    if (queue->msgNumber < queue->msgMax)
+        return false;
+
+    queue->overflowStats.droppedNewest += count;
+    return true;
+}
+
+// Called with mutex held after publisher was counted in activePublishers, waits until there is space
+// for at least one message, OVERFLOW_DROP_OLDEST and OVERFLOW_EVICT_SLOWEST make space instead
+// (drop oldest for all needed messages)
+// Returns 1 when there is space, 0 on timeout (or when OVERFLOW_DROP_NEWEST was set meanwhile)
+// or -1 if queue is being destroyed, on failure publisher is no longer counted and mutex is unlocked
+// Mutex released for spinning is locked again as lock site of caller
+static int waitForSpace(TQueue *queue, int needed, const struct timespec *deadline, QueueLockSite site) {
+    // Lock-free readers leave read messages behind, they are freed before anything is dropped
+    if (queue->reclaim == RECLAIM_HAZARD && queue->msgMax - queue->msgNumber < needed)
+        hazardReclaim(queue);
+    if (queue->overflowPolicy == OVERFLOW_DROP_OLDEST)
+        overflowMakeSpace(queue, needed);
+
+    // Check if there is needed space in queue
+    uint64_t blockedSince = 0;
+    while (queue->msgNumber >= queue->msgMax) {
+        if (overflowDropNewest(queue, needed)) {
+            statsBlocked(queue, true, blockedSince);
+            queue->activePublishers -= 1;
+            queueUnlock(queue);
+            return 0;
+        }
+        if (queue->overflowPolicy != OVERFLOW_BLOCK && overflowMakeSpace(queue, needed))
+            break;
+
+        // Dead subscriber may be what keeps the queue full
+        uint64_t now = queue->maxLagNs > 0 ? monotonicNs() : 0;
+        if (checkLag(queue, atomic_load(&queue->tailSeq), now) > 0)
+            continue;
+
+        if (deadline != NULL && deadlinePassed(deadline)) {
+            statsBlocked(queue, true, blockedSince);
+            queue->activePublishers -= 1;
+            queueUnlock(queue);
+            return 0;
+        }
+        if (blockedSince == 0)
+            blockedSince = monotonicNs();
+
+        // Age limit is checked again at lagCheckNs even if nobody frees space
+        const struct timespec *wakeAt = deadline;
+        struct timespec lagCheck;
+        if (queue->maxLagNs > 0) {
+            lagCheck = (struct timespec){ queue->lagCheckNs / 1000000000ull, queue->lagCheckNs % 1000000000ull };
+            if (deadline == NULL || queue->lagCheckNs < (uint64_t)deadline->tv_sec * 1000000000ull + deadline->tv_nsec)
+                wakeAt = &lagCheck;
+        }
+
+        // Lock-free readers give space back only to waiting publishers, spinning would not see it
+        bool park = true;
+        if (queue->waitStrategy != WAIT_PARK && queue->reclaim != RECLAIM_HAZARD) {
+            queueUnlock(queue);
+            park = spinForSpace(queue, wakeAt);
+            queueLock(queue, site);
+            // Space freed between spin and lock would not be signalled
+            park = park && queue->msgNumber >= queue->msgMax;
+        }
+
+        if (park) {
+            LOG_DEBUG("[P] - Queue full | Waiting for free space\n");
+            queue->waitingPublishers += 1;
+            // Lock-free reader checks waitingPublishers after it moves its cursor, either this scan sees the cursor
+            // or the reader takes mutex to free space and wake publishers
+            if (queue->reclaim != RECLAIM_HAZARD || hazardReclaim(queue) == 0)
+                queueWait(queue, &queue->msgPutCall, wakeAt);
+            queue->waitingPublishers -= 1;
+        }
+
+        if (queue->exitFlag) {
+            statsBlocked(queue, true, blockedSince);
+            queue->activePublishers -= 1;
+            queueUnlock(queue);
+            pthread_cond_broadcast(&queue->msgPutCall);
+            return -1;
+        }
+    }
+    statsBlocked(queue, true, blockedSince);
+    return 1;
+}
+
+// Links chain of added prepared nodes (sequences already assigned) after tail and hands it to subscribers
+// Must be called with mutex held, msgNumber is counted by caller
+static void enqueueChain(TQueue *queue, Message *first, Message *last, int added) {
+    uint64_t seq = first->seq;
+    uint64_t now = queue->maxLagNs > 0 ? monotonicNs() : 0;
+#ifdef PUBSUB_TRACING
+    if (queue->tracing) {
+        if (now == 0)
+            now = monotonicNs();
+        Message *node = first;
+        for (int i = 0; i < added; i++, node = node->next) {
+            node->putNs = now;
+        }
+    }
+#endif
+    // Lock-free readers follow next, message is complete before it is linked
+    if (queue->tail != NULL) {
+        __atomic_store_n(&queue->tail->next, first, __ATOMIC_RELEASE);
+    }
+
+    queue->tail = last;
+    if (queue->head == NULL) {
+        queue->head = first;
+    }
+    atomic_store(&queue->tailSeq, seq + added);
+    statsAdd(&threadStats(queue)->puts, added);
+    statsDepth(queue, queue->msgNumber);
+
+    // Update next message for subscribed threads which read everything and wake waiting threads
+    // once enough messages arrived for their read, other subscribers are not visited
+    int summaryWords = (queue->subscriberChunkCount + 63) / 64;
+    for (int w = 0; w < summaryWords; w++) {
+        for (uint64_t chunks = queue->notifyChunks[w]; chunks != 0; chunks &= chunks - 1) {
+            int c = w * 64 + __builtin_ctzll(chunks);
+            SubscriberChunk *chunk = queue->subscriberChunks[c];
+
+            for (uint64_t bits = chunk->idle; bits != 0; bits &= bits - 1) {
+                Subscriber *sub = &chunk->subs[__builtin_ctzll(bits)];
+                __atomic_store_n(&sub->nextMsg, first, __ATOMIC_RELEASE);
+                sub->lagSinceNs = now;
+            }
+            chunk->idle = 0;
+
+            for (uint64_t bits = chunk->waiters; bits != 0; bits &= bits - 1) {
+                Subscriber *sub = &chunk->subs[__builtin_ctzll(bits)];
+                if (seq + added >= sub->wakeSeq)
+                    pthread_cond_broadcast(&sub->msgGetCall);
+            }
+            notifySummary(queue, c);
+        }
+    }
+
+    // New messages are linked, so receivers of lagging subscribers are dropped from them too
+    wakePublishers(queue, checkLag(queue, seq, now));
+}
+
+// Frees payload buffers of messages from..n-1 which are dropped instead of put (mutex held)
+// Only payloads too long for pooled buffers come copied, others were not copied yet
+static void dropPutBuffers(TQueue *queue, void **msgs, const int *lengths, int from, int n) {
+    for (int i = from; lengths != NULL && i < n; i++) {
+        if (lengths[i] > MSG_INLINE_SIZE && bufferClass(lengths[i]) < 0)
+            bufferFree(queue, msgs[i], lengths[i]);
+    }
+}
+
+// Waits for free space until deadline (NULL waits without limit) and enqueues as many of n messages
+// as fit, all under one lock
+// lengths NULL publishes pointers, otherwise msgs[i] holds payload of lengths[i] bytes, which is copied
+// into node if it fits MSG_INLINE_SIZE, into pooled buffer taken under this lock if it fits a size class,
+// or is already copied malloc buffer, owned by queue once handled
+// Length MSG_PAYLOAD marks TPayload, node takes its own reference
+// handle (may be NULL) receives handle of the first enqueued message
+// Messages dropped by OVERFLOW_DROP_NEWEST count as handled
+// Returns number of handled messages, 0 on timeout or -1 if queue is being destroyed
+static int putMessages(TQueue *queue, void **msgs, const int *lengths, int n, const struct timespec *deadline, TMessageHandle *handle) {
+    queueLock(queue, LOCK_SITE_PUT);
+    if (leaveOnExit(queue))
+        return -1;
+
+    if (overflowDropNewest(queue, n)) {
+        dropPutBuffers(queue, msgs, lengths, 0, n);
+        queueUnlock(queue);
+        LOG_DEBUG("[P] - Queue full | Message dropped\n");
+        return n;
+    }
+
+    queue->activePublishers += 1;
+    int space = waitForSpace(queue, n, deadline, LOCK_SITE_PUT);
+    if (space <= 0)
+        return space;
+
+    if (queue->subscribersNumber == 0) {
+        dropPutBuffers(queue, msgs, lengths, 0, n);
+        statsAdd(&threadStats(queue)->droppedNoSubscribers, n);
+        queue->activePublishers -= 1;
+        TPayload *released = payloadsTake(queue);
+        queueUnlock(queue);
+        payloadsRelease(released);
+        LOG_DEBUG("[U] - Zero subscribers | Removing message\n");
+        return n;
     }
 
-    printf("[Q] - Queue initialized\n");
-}
+    // Take as many new Messages from pool as fit and link them into chain
+    int count = queue->msgMax - queue->msgNumber;
+    if (count > n)
+        count = n;
+
+    Message *first = NULL;
+    Message *last = NULL;
+    uint64_t seq = atomic_load(&queue->tailSeq);
+    int added = 0;
+    for (; added < count; added++) {
+        int length = lengths != NULL ? lengths[added] : MSG_POINTER;
+        void *msg = msgs[added];
+        if (length > MSG_INLINE_SIZE && bufferClass(length) >= 0) {
+            msg = bufferAlloc(queue, length);
+            if (msg == NULL)
+                break;
+            memcpy(msg, msgs[added], length);
+        }
 
-void destroyQueueI(TQueue *queue) {
-    pthread_mutex_lock(&queue->mutex);
-    printf("[D] - Preparation for destroying queue\n");
+        Message *newMessage = poolAlloc(queue);
+        if (newMessage == NULL) {
+            if (msg != msgs[added])
+                bufferFree(queue, msg, length);
+            break;
+        }
 
-    queue->exitFlag = true;
-    // Wait for all "waiting on condition" threads
-    // Using repetitive calls while normal putI & getI methods pass
-    // 1. publishers
-    queue->exitMode = 1;
-    while (queue->activePublishers != 0) {
-        pthread_cond_broadcast(&queue->msgPutCall);
-        pthread_cond_wait(&queue->msgPutCall, &queue->mutex);
+        // Preparing new Message 'object'
+        newMessage->seq = seq + added;
+        newMessage->next = NULL;
+        newMessage->receivers = queue->subscribersNumber;
+        newMessage->length = length;
+        if (messageIsPointer(newMessage) || length > MSG_INLINE_SIZE)
+            newMessage->msg = msg;
+        else
+            memcpy(newMessage->data, msg, length);
+        if (newMessage->length == MSG_PAYLOAD)
+            atomic_fetch_add(&((TPayload *)newMessage->msg)->refs, 1);
+
+        if (last != NULL)
+            last->next = newMessage;
+        else
+            first = newMessage;
+        last = newMessage;
     }
-    printf("[D] - Removed all waiting publishers\n");
 
-    // 2. subscribers
-    queue->exitMode = 2;
-    while (queue->activeSubscribers != 0) {
-        pthread_cond_broadcast(&queue->msgGetCall);
-        pthread_cond_wait(&queue->msgGetCall, &queue->mutex);
+    if (added == 0) {
+        queue->activePublishers -= 1;
+        queueUnlock(queue);
+        LOG_ERROR("[P] - Failed to allocate memory for new message | Message not added \n");
+        return 0;
     }
-    printf("[D] - Removed all waiting subscribers\n");
 
-    // Clear all Messages structures
-    Message *tmp = queue->head;
-    while (tmp != NULL) {
-        queue->head = tmp->next;
-        free(tmp);
-        tmp = queue->head;        
+    queue->msgNumber += added;
+    enqueueChain(queue, first, last, added);
+    // Sequence is not read back from node, linked chain may be reclaimed before put returns
+    if (handle != NULL)
+        *handle = (TMessageHandle){ first, seq };
+
+    // Rest of batch which did not fit
+    int handled = added;
+    if (added == count && count < n && overflowDropNewest(queue, n - count)) {
+        dropPutBuffers(queue, msgs, lengths, count, n);
+        handled = n;
     }
 
-    // Clear rest of the TQueue structure
-    pthread_mutex_t *copy = &queue->mutex;
-    free(queue);
-    pthread_mutex_unlock(copy);
-    pthread_mutex_destroy(copy);
+    // Messages dropped by overflow policy may release payloads
+    queue->activePublishers -= 1;
+    TPayload *released = payloadsTake(queue);
+    queueUnlock(queue);
+    payloadsRelease(released);
+    if (added < count)
+        LOG_ERROR("[P] - Failed to allocate memory for new message | Message not added \n");
+    LOG_DEBUG("[P] - Added new message\n");
+    return handled;
+}
+
+// Normally returning 0, if error occurs returning -1 (error includes destroying queue)
+int putI(TQueue *queue, void *msg) {
+    if (queue->engine == ENGINE_RING)
+        return ringPutBatch(queue, &msg, 1, NULL) < 0 ? -1 : 0;
 
-    printf("[D] - Queue destroyed\n");
+    return putMessages(queue, &msg, NULL, 1, NULL, NULL) < 0 ? -1 : 0;
 }
 
-bool subscribeI(TQueue *queue, pthread_t thread) {
-    pthread_mutex_lock(&queue->mutex);
-    for (int i = 0; i < MAX_SUBS; i++) {
-        if (queue->subscribers[i].threadId == -1) {
-            queue->subscribers[i].threadId = thread;
-            queue->subscribersNumber += 1;
-            pthread_mutex_unlock(&queue->mutex);
-            pthread_cond_broadcast(&queue->msgPutCall);
-            printf("[S] - Thread subscribed to queue\n");
-            return true;
-        }
-    }
-    pthread_mutex_unlock(&queue->mutex);
-    printf("[S] - Thread failed while subscribing to queue\n");
-    return false;
+// Like putI, handle receives handle for removeByHandleI
+// Handle node is NULL if message was dropped (no subscribers) or queue uses ring engine
+int putHandleI(TQueue *queue, void *msg, TMessageHandle *handle) {
+    *handle = (TMessageHandle){ NULL, 0 };
+    if (queue->engine == ENGINE_RING)
+        return ringPutBatch(queue, &msg, 1, NULL) < 0 ? -1 : 0;
+
+    return putMessages(queue, &msg, NULL, 1, NULL, handle) < 0 ? -1 : 0;
 }
 
-void unsubscribeI(TQueue *queue, pthread_t thread) {
-    pthread_mutex_lock(&queue->mutex);
-    Message *threadNextMsg;
+// Waits for free space until deadline (absolute CLOCK_MONOTONIC time)
+// Returns 1 if message was published, 0 if queue stayed full or -1 if queue is being destroyed
+int putTimedI(TQueue *queue, void *msg, const struct timespec *deadline) {
+    if (queue->engine == ENGINE_RING)
+        return ringPutBatch(queue, &msg, 1, deadline);
+
+    return putMessages(queue, &msg, NULL, 1, deadline, NULL);
+}
 
-    for (int i = 0; i < MAX_SUBS; i++) {
-        if (queue->subscribers[i].threadId == thread) {
-            queue->subscribersNumber -= 1;
+// Never blocks, returns like putTimedI
+int tryPutI(TQueue *queue, void *msg) {
+    return putTimedI(queue, msg, &noWait);
+}
 
-            // Get its last message
-            threadNextMsg = queue->subscribers[i].nextMsg;
+// Publishes up to n messages with one lock and one wake-up
+// Blocks until there is space for at least one, returns number of published messages
+// (remaining ones have to be put again) or -1 if queue is being destroyed
+int putBatchI(TQueue *queue, void **msgs, int n) {
+    if (n <= 0)
+        return 0;
 
-            // Remove from subscribers list
-            queue->subscribers[i].threadId = -1;
-            queue->subscribers[i].nextMsg = NULL;
-            break;
-        }
-    }
+    if (queue->engine == ENGINE_RING)
+        return ringPutBatch(queue, msgs, n, NULL);
 
-    // If thread has unread messages then
-    if (threadNextMsg != NULL) {
-        // Traverse and decrement msg receivers number starting from newest unread
-        Message *tmp = queue->head;
-    
-        bool isFirstMsgFound = false;
-        while(tmp != NULL) {
-            if (tmp == threadNextMsg) {
-                isFirstMsgFound = true;
-                tmp->receivers -= 1;
-            } else {
-                if (isFirstMsgFound) {
-                    tmp->receivers -= 1;
-                }
-            }
+    return putMessages(queue, msgs, NULL, n, NULL, NULL);
+}
 
-            // Check if there is Message with no receivers
-            if (tmp->receivers == 0) {
-                printf("[U] - Found empty message | Deleting message\n");
-                queue->msgNumber -= 1;
-                if (queue->head == queue->tail) {
-                    queue->tail = tmp->next;
-                }
-                queue->head = tmp->next;
-                tmp->msg = NULL;
-                free(tmp);
-             }
+// Publishes copy of len bytes from buf, so buf can be reused right after the call
+// Payload up to MSG_INLINE_SIZE is stored in the message node, longer one in pooled buffer owned by queue
+// Pooled buffer is taken and filled under the enqueue lock, so put takes the mutex once,
+// payload longer than the largest size class is copied into malloc buffer before
+// Read it with getCopyI, returns like putI (list engine only)
+int putCopyI(TQueue *queue, const void *buf, int len) {
+    if (queue->engine == ENGINE_RING || len < 0) {
+        LOG_ERROR("[P] - Copy mode is supported only by list engine | Message not added\n");
+        return -1;
+    }
 
-            tmp = tmp->next;
+    void *payload = (void *)buf;
+    bool isUnpooled = len > MSG_INLINE_SIZE && bufferClass(len) < 0;
+    if (isUnpooled) {
+        payload = malloc(len);
+        if (payload == NULL) {
+            LOG_ERROR("[P] - Failed to allocate payload buffer | Message not added\n");
+            return 0;
         }
+        memcpy(payload, buf, len);
     }
 
-    pthread_cond_broadcast(&queue->msgPutCall);
-    pthread_mutex_unlock(&queue->mutex);
+    int result = putMessages(queue, &payload, &len, 1, NULL, NULL);
+    if (result <= 0 && isUnpooled)
+        free(payload);
+    return result < 0 ? -1 : 0;
 }
 
-// Normally returning 0, if error occurs returning -1 (error includes destroying queue)
-int putI(TQueue *queue, void *msg) {
-    pthread_mutex_lock(&queue->mutex);
-    // Notice queue destroy procedure and its status (mode)
-    if (queue->exitFlag) {
-        int exitMode = queue->exitMode;
-        pthread_mutex_unlock(&queue->mutex);
+// Sets payload with one reference, owned by the caller
+void initPayloadI(TPayload *payload, void *data, int length, void (*release)(TPayload *payload), void *context) {
+    atomic_init(&payload->refs, 1);
+    payload->release = release;
+    payload->context = context;
+    payload->data = data;
+    payload->length = length;
+    payload->nextReleased = NULL;
+}
 
-        if (exitMode == 1)
-            pthread_cond_broadcast(&queue->msgPutCall);
-        else if (exitMode == 2)
-            pthread_cond_broadcast(&queue->msgGetCall);
+void retainPayloadI(TPayload *payload) {
+    atomic_fetch_add(&payload->refs, 1);
+}
+
+// Drops one reference, the last one calls release callback
+void releasePayloadI(TPayload *payload) {
+    if (atomic_fetch_sub(&payload->refs, 1) == 1 && payload->release != NULL)
+        payload->release(payload);
+}
 
+// Publishes payload without copying, message holds own reference until it is read by all subscribers
+// or dropped, every subscriber which gets it owns one reference and calls releasePayloadI when done
+// Caller keeps its reference (release it right after put if it is not needed), returns like putI (list engine only)
+int putPayloadI(TQueue *queue, TPayload *payload) {
+    if (queue->engine == ENGINE_RING) {
+        LOG_ERROR("[P] - Payload mode is supported only by list engine | Message not added\n");
         return -1;
     }
 
-    queue->activePublishers += 1;
+    int length = MSG_PAYLOAD;
+    void *msg = payload;
+    return putMessages(queue, &msg, &length, 1, NULL, NULL) < 0 ? -1 : 0;
+}
 
-    // Check if there is needed space in queue
-    while (queue->msgNumber == queue->msgMax) {
-        printf("[P] - Queue full | Waiting for free space\n");
-        pthread_cond_wait(&queue->msgPutCall, &queue->mutex);
+void abortPutI(TQueue *queue, TPutSlot slot);
+
+// Reserves space for message of len bytes in queue owned storage, handles full queue like putI
+// Reserved message counts into msgMax, but subscribers see it only after commitPutI, abortPutI drops it
+// Publisher stays active until commit or abort, so destroyQueueI waits for open reservations
+// Returns slot with data NULL if queue is being destroyed, allocation failed or OVERFLOW_DROP_NEWEST
+// dropped the message (list engine only)
+TPutSlot reservePutI(TQueue *queue, int len) {
+    TPutSlot slot = { NULL, len, NULL };
+    if (queue->engine == ENGINE_RING || len < 0) {
+        LOG_ERROR("[P] - Reserve is supported only by list engine | Nothing reserved\n");
+        return slot;
+    }
 
-        if (queue->exitFlag) {
+    queueLock(queue, LOCK_SITE_RESERVE);
+    if (leaveOnExit(queue))
+        return slot;
+
+    if (overflowDropNewest(queue, 1)) {
+        queueUnlock(queue);
+        LOG_DEBUG("[P] - Queue full | Nothing reserved\n");
+        return slot;
+    }
+
+    // Policy may change to OVERFLOW_DROP_NEWEST while it waits, mutex is released then too
+    queue->activePublishers += 1;
+    if (waitForSpace(queue, 1, NULL, LOCK_SITE_RESERVE) <= 0)
+        return slot;
+
+    Message *node = poolAlloc(queue);
+    if (node == NULL) {
+        queue->activePublishers -= 1;
+        queueUnlock(queue);
+        LOG_ERROR("[P] - Failed to allocate memory for new message | Nothing reserved\n");
+        return slot;
+    }
+    // Payload buffer is taken under this lock too, so reserve takes the mutex once
+    node->length = len;
+    if (len > MSG_INLINE_SIZE) {
+        node->msg = bufferAlloc(queue, len);
+        if (node->msg == NULL) {
+            node->length = 0;
+            poolFree(queue, node);
             queue->activePublishers -= 1;
-            pthread_mutex_unlock(&queue->mutex);
-            pthread_cond_broadcast(&queue->msgPutCall);
-            return -1;
+            queueUnlock(queue);
+            LOG_ERROR("[P] - Failed to allocate payload buffer | Nothing reserved\n");
+            return slot;
         }
     }
+    queue->msgNumber += 1;
+    TPayload *released = payloadsTake(queue);
+    queueUnlock(queue);
+    payloadsRelease(released);
+
+    slot.node = node;
+    slot.data = len <= MSG_INLINE_SIZE ? node->data : node->msg;
+    return slot;
+}
+
+// Publishes reserved message, its sequence is assigned now, so messages appear in commit order
+// Returns 0, or -1 if queue is being destroyed (message is dropped)
+int commitPutI(TQueue *queue, TPutSlot slot) {
+    if (slot.node == NULL)
+        return -1;
 
-    // Create new Message
-    Message *newMessage = malloc(sizeof(Message));
-    if (newMessage == NULL) {
-        printf("[P] - Failed to allocate memory for new message | Message not added \n");
+    queueLock(queue, LOCK_SITE_COMMIT);
+    Message *node = slot.node;
+    if (queue->exitFlag || queue->subscribersNumber == 0) {
+        bool isExit = queue->exitFlag;
+        queue->msgNumber -= 1;
+        poolFree(queue, node);
+        wakePublishers(queue, 1);
+        statsAdd(&threadStats(queue)->droppedNoSubscribers, 1);
         queue->activePublishers -= 1;
-        pthread_mutex_unlock(&queue->mutex);
-        pthread_cond_broadcast(&queue->msgGetCall);
+        queueUnlock(queue);
+
+        if (isExit) {
+            pthread_cond_broadcast(&queue->msgPutCall);
+            return -1;
+        }
+        LOG_DEBUG("[U] - Zero subscribers | Removing message\n");
         return 0;
     }
 
-    if (queue->subscribersNumber == 0) {
-        printf("[U] - Zero subscribers | Removing message\n");
-        free(newMessage);
-        queue->activePublishers -= 1;
-        pthread_mutex_unlock(&queue->mutex);
-        pthread_cond_broadcast(&queue->msgGetCall);
-        return 0;
+    node->seq = atomic_load(&queue->tailSeq);
+    node->next = NULL;
+    node->receivers = queue->subscribersNumber;
+    enqueueChain(queue, node, node, 1);
+
+    // Subscribers detached for lag may release payloads
+    queue->activePublishers -= 1;
+    TPayload *released = payloadsTake(queue);
+    queueUnlock(queue);
+    payloadsRelease(released);
+    LOG_DEBUG("[P] - Added new message\n");
+    return 0;
+}
+
+// Drops reserved message and frees its space
+void abortPutI(TQueue *queue, TPutSlot slot) {
+    if (slot.node == NULL)
+        return;
+
+    queueLock(queue, LOCK_SITE_COMMIT);
+    queue->msgNumber -= 1;
+    poolFree(queue, slot.node);
+    wakePublishers(queue, 1);
+    queue->activePublishers -= 1;
+    bool isExit = queue->exitFlag;
+    queueUnlock(queue);
+
+    if (isExit)
+        pthread_cond_broadcast(&queue->msgPutCall);
+    LOG_DEBUG("[P] - Reserved message aborted\n");
+}
+
+// Destination of getCopyI, filled while the message node is still alive
+typedef struct {
+    void *buffer;
+    int capacity;
+    int length;
+    TPayload *payload; // copied TPayload, its reference is released by getCopyI
+} MessageCopy;
+
+// Copies payload of read message, pointer messages have none
+static void copyMessage(MessageCopy *copy, Message *node, int length) {
+    const void *data = length > MSG_INLINE_SIZE ? node->msg : node->data;
+    copy->length = length == MSG_POINTER ? 0 : length;
+    if (length == MSG_PAYLOAD) {
+        copy->payload = node->msg;
+        data = copy->payload->data;
+        copy->length = copy->payload->length;
     }
+    int copied = copy->length < copy->capacity ? copy->length : copy->capacity;
+    memcpy(copy->buffer, data, copied);
+}
 
-    // Preparing new Message 'object'
-    newMessage->next = NULL;
-    newMessage->receivers = queue->subscribersNumber;
-    newMessage->msg = msg;
+// Reads up to max messages from claimed cursor of RECLAIM_HAZARD subscriber, with or without mutex
+// Nodes from cursor onward stay alive until it moves, so copy is filled before that
+static int consumeCursor(TQueue *queue, Subscriber *sub, void **out, int max, MessageCopy *copy) {
+    Message *cursor = __atomic_load_n(&sub->nextMsg, __ATOMIC_ACQUIRE);
+    if (cursor == NULL)
+        return 0;
 
-    // Enqueue new Message
-    queue->msgNumber++;
-    if (queue->tail != NULL) {
-        queue->tail->next = newMessage;
+    Message *last = cursorNode(cursor);
+    Message *node = cursorPassed(cursor) ? __atomic_load_n(&last->next, __ATOMIC_ACQUIRE) : last;
+    if (node == NULL)
+        return 0;
+
+    uint64_t readSeq = atomic_load(&sub->readSeq);
+    uint64_t skippedRead = 0;
+    int count = 0;
+    Message *lastRead = NULL;
+    int lastLength = 0;
+#ifdef PUBSUB_TRACING
+    uint64_t readNs = sub->latency != NULL ? monotonicNs() : 0;
+#endif
+    for (; node != NULL && count < max; node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) {
+        skippedRead += node->seq - readSeq;
+        readSeq = node->seq + 1;
+        last = node;
+        // Cursor is claimed, so removeMessage marked it before and counted it in skipped
+        int length = __atomic_load_n(&node->length, __ATOMIC_ACQUIRE);
+        if (length == MSG_REMOVED) {
+            skippedRead += 1;
+            continue;
+        }
+
+#ifdef PUBSUB_TRACING
+        if (sub->latency != NULL) {
+            // Publishers link messages during the walk, node stamped after readNs was linked after it too
+            if (node->putNs > readNs)
+                readNs = monotonicNs();
+            traceRecord(sub->latency, readNs - node->putNs);
+        }
+#endif
+        out[count++] = length == MSG_POINTER || length == MSG_PAYLOAD ? node->msg : MSG_COPIED;
+        if (length == MSG_PAYLOAD)
+            atomic_fetch_add(&((TPayload *)node->msg)->refs, 1);
+        lastRead = node;
+        lastLength = length;
     }
+    if (copy != NULL && lastRead != NULL)
+        copyMessage(copy, lastRead, lastLength);
+
+    // Read tail stays in cursor, next message is found through it once it is linked
+    __atomic_store_n(&sub->nextMsg, node != NULL ? node : (Message *)((uintptr_t)last | CURSOR_PASSED), __ATOMIC_SEQ_CST);
+    atomic_fetch_sub(&sub->skipped, skippedRead);
+    atomic_store(&sub->readSeq, readSeq);
+    // Read tail is not idle, so put does not restart its clock, lag check does (see subscriberLagging)
+    if (__atomic_load_n(&queue->maxLagNs, __ATOMIC_RELAXED) > 0)
+        __atomic_store_n(&sub->lagSinceNs, node != NULL ? monotonicNs() : 0, __ATOMIC_RELAXED);
+    return count;
+}
 
-    queue->tail = newMessage;
-    if (queue->head == NULL) {
-        queue->head = newMessage;
+// Reads messages which are already in RECLAIM_HAZARD queue without mutex, returns number of read messages
+// 0 leaves it to getMessages (fewer than minCount unread, cursor claimed by another thread, invalid handle)
+static int getLockFree(TQueue *queue, TSubscriberHandle handle, void **out, int max, int minCount, MessageCopy *copy) {
+    // handleSlot needs mutex, generation alone tells whether handle is still subscribed
+    Subscriber *sub = subscriberAt(queue, HANDLE_SLOT(handle));
+    if (sub == NULL || atomic_load(&sub->generation) != HANDLE_GENERATION(handle))
+        return 0;
+    if (subscriberAvailable(queue, sub) < minCount || !subscriberTryClaim(sub))
+        return 0;
+
+    // Unsubscribe and destroy change them before they claim the cursor
+    if (atomic_load(&sub->generation) != HANDLE_GENERATION(handle) || queue->exitFlag) {
+        subscriberRelease(sub);
+        return 0;
     }
 
-    // Update next message for subscribed threads with any unread messages
-    for (int i = 0; i < MAX_SUBS; i++) {
-        if (
-            queue->subscribers[i].threadId != -1 &&
-            queue->subscribers[i].nextMsg == NULL
-        )
-            queue->subscribers[i].nextMsg = newMessage;
+    int count = consumeCursor(queue, sub, out, max, copy);
+    if (count > 0)
+        statsAdd(&threadStats(queue)->gets, count);
+    if (count == 0 || queue->waitingPublishers == 0) {
+        subscriberRelease(sub);
+        return count;
     }
 
-    printf("[P] - Added new message\n");
-    queue->activePublishers -= 1;
-    pthread_mutex_unlock(&queue->mutex);
-    pthread_cond_broadcast(&queue->msgGetCall);
-    return 0;
+    // Publisher waits for space, destroy waits for readers counted before they release cursor
+    atomic_fetch_add(&queue->reclaimingReaders, 1);
+    subscriberRelease(sub);
+    queueLock(queue, LOCK_SITE_GET);
+    TPayload *released = NULL;
+    if (!queue->exitFlag) {
+        wakePublishers(queue, hazardReclaim(queue));
+        released = payloadsTake(queue);
+    }
+    queueUnlock(queue);
+    payloadsRelease(released);
+    atomic_fetch_sub(&queue->reclaimingReaders, 1);
+    return count;
 }
 
-// Returns pointer to message, if error occurs returning NULL (error includes destroying queue)
-void *getI(TQueue *queue, pthread_t thread) {
-    pthread_mutex_lock(&queue->mutex);
-    // Notice queue destroy procedure and its status (mode)
-    if (queue->exitFlag) {
-        int exitMode = queue->exitMode;
-        pthread_mutex_unlock(&queue->mutex);
-        if (exitMode == 1)
-            pthread_cond_broadcast(&queue->msgPutCall);
-        else if (exitMode == 2)
-            pthread_cond_broadcast(&queue->msgGetCall);
-        
-        return NULL;
+// Waits until at least minCount messages are unread or deadline (may be NULL) passes,
+// then reads up to max of them under one lock
+// Copied messages are stored as MSG_COPIED, copy (may be NULL) receives payload of the last read message
+// Caller gets one reference of every read TPayload
+// Returns number of read messages, 0 on timeout or -1 if error occurs (error includes destroying queue),
+// GET_LAGGED_OUT if subscriber was unsubscribed for exceeding lag limit
+static int getMessages(TQueue *queue, TSubscriberHandle handle, void **out, int max, int minCount, const struct timespec *deadline, MessageCopy *copy) {
+    if (queue->reclaim == RECLAIM_HAZARD) {
+        int lockFree = getLockFree(queue, handle, out, max, minCount, copy);
+        if (lockFree > 0)
+            return lockFree;
     }
 
+    queueLock(queue, LOCK_SITE_GET);
+    if (leaveOnExit(queue))
+        return -1;
+
     queue->activeSubscribers += 1;
 
-    // Find threadId in subscribers list
-    int threadSubId = -1; // -1 marks that thread is not in subscribers list
-    for (int i = 0; i < MAX_SUBS; i++) {
-        if (queue->subscribers[i].threadId == thread) {
-            threadSubId = i;
-            break;
-        }
-    }
-    
+    // Find subscriber slot, -1 marks that thread is not in subscribers list
+    int threadSubId = handleSlot(queue, handle);
     if (threadSubId == -1) {
         queue->activeSubscribers -= 1;
-        pthread_mutex_unlock(&queue->mutex);
-        printf("[S] - Thread is no longer subscribed | Returning NULL\n");
-        return NULL;
+        int status = unsubscribedStatus(queue, handle);
+        queueUnlock(queue);
+        LOG_INFO(status == GET_LAGGED_OUT ? "[S] - Subscriber lagged out | Returning lagged out\n"
+            : "[S] - Thread is no longer subscribed | Returning NULL\n");
+        return status;
     }
 
-    // Get newest unread message pointer
-    Message *nextThreadMsg = queue->subscribers[threadSubId].nextMsg;
-    
-    while (nextThreadMsg == NULL) {
-        printf("[S] - All messages readed | Waiting for new one\n");
-        pthread_cond_wait(&queue->msgGetCall, &queue->mutex);
+    // Waiting for more than fits in the queue would never end
+    if (minCount > queue->msgMax)
+        minCount = queue->msgMax;
+
+    // Removed messages are counted in skipped, wait again if lock-free get of same subscriber read them first
+    Subscriber *sub = subscriberAt(queue, threadSubId);
+    int count = 0;
+    int freed = 0;
+    Message *lastRead = NULL;
+    uint64_t blockedSince = 0;
+    while (count == 0) {
+        // Wait for minCount messages, after deadline any unread message is enough
+        int available = subscriberAvailable(queue, sub);
+        bool isExpired = available < minCount && deadline != NULL && deadlinePassed(deadline);
+        while (available < minCount && !(isExpired && available > 0)) {
+            if (isExpired) {
+                statsBlocked(queue, false, blockedSince);
+                queue->activeSubscribers -= 1;
+                queueUnlock(queue);
+                return 0;
+            }
+            if (blockedSince == 0)
+                blockedSince = monotonicNs();
+
+            bool park = true;
+            if (queue->waitStrategy != WAIT_PARK) {
+                // Spin outside of mutex, lock-free sequence counters show when messages arrive
+                queueUnlock(queue);
+                park = spinForMessages(queue, handle, minCount, deadline);
+                queueLock(queue, LOCK_SITE_GET);
+                isExpired = deadline != NULL && deadlinePassed(deadline);
+                // Messages put between spin and lock would not be signalled
+                park = park && subscriberAvailable(queue, sub) < minCount;
+            }
+
+            if (park && !isExpired) {
+                LOG_DEBUG("[S] - All messages readed | Waiting for new one\n");
+                // Publisher wakes this slot once tail reaches wakeSeq, earliest one wins if more threads wait
+                uint64_t wakeSeq = atomic_load(&queue->tailSeq) + (minCount - subscriberAvailable(queue, sub));
+                if (sub->waiting == 0 || wakeSeq < sub->wakeSeq)
+                    sub->wakeSeq = wakeSeq;
+
+                sub->waiting += 1;
+                setWaiting(queue, threadSubId, true);
+                isExpired = queueWait(queue, &sub->msgGetCall, deadline) == ETIMEDOUT;
+                sub->waiting -= 1;
+                setWaiting(queue, threadSubId, sub->waiting > 0);
+            }
         
-        if (queue->exitFlag) {
-            queue->activeSubscribers -= 1;
-            pthread_mutex_unlock(&queue->mutex);
-            pthread_cond_broadcast(&queue->msgGetCall);
-            return NULL;
+            if (queue->exitFlag) {
+                statsBlocked(queue, false, blockedSince);
+                queue->activeSubscribers -= 1;
+                queueUnlock(queue);
+                pthread_cond_broadcast(&queue->msgGetCall);
+                return -1;
+            }
+
+            // Check if its still subscribed
+            if (handleSlot(queue, handle) != threadSubId) {
+                statsBlocked(queue, false, blockedSince);
+                queue->activeSubscribers -= 1;
+                int status = unsubscribedStatus(queue, handle);
+                queueUnlock(queue);
+                LOG_INFO(status == GET_LAGGED_OUT ? "[S] - Subscriber lagged out | Returning lagged out\n"
+                    : "[S] - Thread is no longer subscribed | Returning NULL\n");
+                return status;
+            }
+            available = subscriberAvailable(queue, sub);
+        }
+
+        if (queue->reclaim == RECLAIM_HAZARD) {
+            subscriberClaim(queue, sub);
+            count = consumeCursor(queue, sub, out, max, copy);
+            subscriberUnclaim(queue, sub);
+            int reclaimed = queue->waitingPublishers > 0 ? hazardReclaim(queue) : 0;
+            wakePublishers(queue, reclaimed);
+            freed += reclaimed;
+            continue;
         }
 
-        // Check if its still subscribed
-        if (queue->subscribers[threadSubId].threadId != thread) {
-            queue->activeSubscribers -= 1;
-            pthread_mutex_unlock(&queue->mutex);
-            printf("[S] - Thread is no longer subscribed | Returning NULL\n");
-            return NULL;
+        // Consume directly from subscriber cursor
+        // Gap between read sequence and message and passed tombstones are removed messages counted in skipped
+        uint64_t readSeq = atomic_load(&sub->readSeq);
+        uint64_t skippedRead = 0;
+        Message *node = sub->nextMsg;
+        // Messages are available, so cursor moves off its first message
+        bool countReceivers = queue->reclaim == RECLAIM_RECEIVERS;
+        uint64_t cursor = node->seq;
+#ifdef PUBSUB_TRACING
+        uint64_t readNs = sub->latency != NULL ? monotonicNs() : 0;
+#endif
+        for (; node != NULL && count < max; node = node->next) {
+            skippedRead += node->seq - readSeq;
+            readSeq = node->seq + 1;
+            if (countReceivers)
+                node->receivers -= 1;
+            if (node->length == MSG_REMOVED) {
+                skippedRead += 1;
+                continue;
+            }
+
+#ifdef PUBSUB_TRACING
+            if (sub->latency != NULL)
+                traceRecord(sub->latency, readNs - node->putNs);
+#endif
+            out[count++] = messageIsPointer(node) ? node->msg : MSG_COPIED;
+            if (node->length == MSG_PAYLOAD)
+                atomic_fetch_add(&((TPayload *)node->msg)->refs, 1);
+            lastRead = node;
         }
-        nextThreadMsg = queue->subscribers[threadSubId].nextMsg;
+        sub->nextMsg = node;
+        if (node == NULL)
+            setIdle(queue, threadSubId, true);
+        else if (queue->maxLagNs > 0)
+            sub->lagSinceNs = monotonicNs();
+
+        // Node is reclaimed only below
+        if (copy != NULL && lastRead != NULL)
+            copyMessage(copy, lastRead, lastRead->length);
+        atomic_fetch_sub(&sub->skipped, skippedRead);
+        atomic_store(&sub->readSeq, readSeq);
+        if (!countReceivers)
+            cursorLeft(queue, cursor);
+
+        // Free oldest messages read by all receivers
+        int reclaimed = reclaimHead(queue);
+        wakePublishers(queue, reclaimed);
+        freed += reclaimed;
     }
 
-    // Get newest message by pointer
-    void *msg;
-    Message *tmp = queue->head;
-    while (tmp != NULL) {
-        if (tmp == nextThreadMsg) {
-            // Save next message
-             queue->subscribers[threadSubId].nextMsg = tmp->next;
-             // Save message
-             msg = tmp->msg;
-             tmp->receivers -= 1;
-
-             // If its last read of message - delete it
-             if (tmp->receivers == 0) {
-                printf("[U] - Message was read by the last subscriber | Deleting message\n");
-                queue->msgNumber -= 1;
-
-                if (queue->head == queue->tail) {
-                    queue->tail = tmp->next;
-                }
-                queue->head = tmp->next;
-                // tmp->msg = NULL;
-                free(tmp);
-             }
-             queue->activeSubscribers -= 1;
-             pthread_mutex_unlock(&queue->mutex);
-             pthread_cond_broadcast(&queue->msgPutCall);
-             return msg;
-        }
-        tmp = tmp->next;
-    }
-
-    // Secure exit - shouldn't be necessary
+    statsAdd(&threadStats(queue)->gets, count);
+    statsBlocked(queue, false, blockedSince);
     queue->activeSubscribers -= 1;
-    pthread_mutex_unlock(&queue->mutex);
-    pthread_cond_broadcast(&queue->msgPutCall);
-    return NULL;
+    TPayload *released = payloadsTake(queue);
+    queueUnlock(queue);
+    payloadsRelease(released);
+    if (freed > 0) {
+        LOG_DEBUG("[U] - Message was read by the last subscriber | Deleting message\n");
+    }
+    return count;
 }
 
-int getAvailableI(TQueue *queue, pthread_t thread) {
-    pthread_mutex_lock(&queue->mutex);
+// Returns pointer to message, if error occurs returning NULL (error includes destroying queue)
+// MSG_LAGGED_OUT if subscriber was unsubscribed for exceeding lag limit
+void *getByHandleI(TQueue *queue, TSubscriberHandle handle) {
+    void *msg = NULL;
+    if (queue->engine == ENGINE_RING)
+        ringGetBatch(queue, handle, &msg, 1, 1, NULL);
+    else if (getMessages(queue, handle, &msg, 1, 1, NULL, NULL) == GET_LAGGED_OUT)
+        msg = MSG_LAGGED_OUT;
+    return msg;
+}
 
-    Message *nextThreadMsg;
-    // Find thread next unread message in subscribers list
-    bool isSubscriberFound = false;
-    for (int i = 0; i < MAX_SUBS; i++) {
-        if (queue->subscribers[i].threadId == thread) {
-            nextThreadMsg = queue->subscribers[i].nextMsg;
-            isSubscriberFound = true;
-            break;
-        }
-    }
+// Like getBatchI, but waits until at least minCount messages are unread, so subscriber is woken
+// once per batch instead of once per message. Deadline is absolute CLOCK_MONOTONIC time (NULL waits
+// without limit), after it passes whatever is unread is returned, 0 if nothing is
+int getBatchWaitI(TQueue *queue, TSubscriberHandle handle, void **out, int max, int minCount, const struct timespec *deadline) {
+    if (max <= 0)
+        return 0;
+
+    if (minCount > max)
+        minCount = max;
+    if (minCount < 1)
+        minCount = 1;
+
+    if (queue->engine == ENGINE_RING)
+        return ringGetBatch(queue, handle, out, max, minCount, deadline);
+
+    return getMessages(queue, handle, out, max, minCount, deadline, NULL);
+}
 
-    if (!isSubscriberFound) {
-        pthread_mutex_unlock(&queue->mutex);
+// Blocks until there is at least one unread message, then reads up to max messages with one lock
+// Returns number of read messages or -1 if error occurs (error includes destroying queue),
+// GET_LAGGED_OUT if subscriber was unsubscribed for exceeding lag limit
+int getBatchI(TQueue *queue, TSubscriberHandle handle, void **out, int max) {
+    return getBatchWaitI(queue, handle, out, max, 1, NULL);
+}
+
+// Waits for message until deadline (absolute CLOCK_MONOTONIC time)
+// Returns 1 and stores message to msg, 0 if there was none or -1 if error occurs
+int getTimedI(TQueue *queue, TSubscriberHandle handle, void **msg, const struct timespec *deadline) {
+    return getBatchWaitI(queue, handle, msg, 1, 1, deadline);
+}
+
+// Never blocks, returns like getTimedI
+int tryGetI(TQueue *queue, TSubscriberHandle handle, void **msg) {
+    return getBatchWaitI(queue, handle, msg, 1, 1, &noWait);
+}
+
+// Blocks until there is unread message and copies its payload into buf, up to capacity bytes
+// Returns payload length (longer than capacity if it was truncated), 0 for message put by pointer
+// or -1 if error occurs (error includes destroying queue), list engine only
+// TPayload is copied too and its reference released
+int getCopyI(TQueue *queue, TSubscriberHandle handle, void *buf, int capacity) {
+    if (queue->engine == ENGINE_RING)
+        return -1;
+
+    void *msg;
+    MessageCopy copy = { buf, capacity, 0, NULL };
+    int result = getMessages(queue, handle, &msg, 1, 1, NULL, &copy);
+    if (result < 0)
+        return result;
+    if (copy.payload != NULL)
+        releasePayloadI(copy.payload);
+    return copy.length;
+}
+
+void *getI(TQueue *queue, pthread_t thread) {
+    return getByHandleI(queue, cachedHandle(queue, thread));
+}
+
+// Lock-free, values are read with atomic loads and may be briefly out of date
+int getAvailableByHandleI(TQueue *queue, TSubscriberHandle handle) {
+    if (queue->engine == ENGINE_RING)
+        return ringGetAvailable(queue, handle);
+
+    Subscriber *sub = subscriberAt(queue, HANDLE_SLOT(handle));
+    if (sub == NULL)
         return 0;
-    }
 
-    // Count unread messages starting from next unread
-    int unreadMessages = 0;
-    while (nextThreadMsg != NULL) {
-        unreadMessages++;
-        nextThreadMsg = nextThreadMsg->next;
-    }
+    uint32_t generation = HANDLE_GENERATION(handle);
+    if (atomic_load(&sub->generation) != generation)
+        return 0;
 
-    pthread_mutex_unlock(&queue->mutex);
-    return unreadMessages;
+    uint64_t readSeq = atomic_load(&sub->readSeq);
+    uint64_t skipped = atomic_load(&sub->skipped);
+    uint64_t tailSeq = atomic_load(&queue->tailSeq);
+
+    // Slot could be reused meanwhile
+    if (atomic_load(&sub->generation) != generation)
+        return 0;
+
+    int64_t unreadMessages = (int64_t)(tailSeq - readSeq - skipped);
+    return unreadMessages > 0 ? (int)unreadMessages : 0;
 }
 
-void removeI(TQueue *queue, void *msg) {
-    pthread_mutex_lock(&queue->mutex);
+int getAvailableI(TQueue *queue, pthread_t thread) {
+    return getAvailableByHandleI(queue, cachedHandle(queue, thread));
+}
+
+// Sequence of next put message, tail minus read sequence gives subscriber lag
+uint64_t getTailSeqI(TQueue *queue) {
+    if (queue->engine == ENGINE_RING)
+        return atomic_load(&queue->ring->claimSeq);
+    return atomic_load(&queue->tailSeq);
+}
 
-    // Look for message position in queue
-    // Check if its (0) no messages, (1) only one message in queue, (2) head, (3) tail or (4) between them
+// Sequence of next message for subscriber, 0 if handle is not valid
+uint64_t getReadSeqI(TQueue *queue, TSubscriberHandle handle) {
+    if (queue->engine == ENGINE_RING)
+        return ringGetReadSeq(queue, handle);
+
+    Subscriber *sub = subscriberAt(queue, HANDLE_SLOT(handle));
+    if (sub == NULL)
+        return 0;
+
+    uint64_t readSeq = atomic_load(&sub->readSeq);
+    if (atomic_load(&sub->generation) != HANDLE_GENERATION(handle))
+        return 0;
+    return readSeq;
+}
 
-    Message *messageToRemove;
-    Message *nextMessage;
-    // (0)
-    if (queue->head == NULL || queue->tail == NULL) {
-        pthread_mutex_unlock(&queue->mutex);
-        printf("[R] - Message for remove not found\n");
+// Removes first unread message with pointer msg, search walks from head
+// Subscribers skip removed message lazily, getAvailableI does not count it any more
+void removeI(TQueue *queue, void *msg) {
+    if (queue->engine == ENGINE_RING) {
+        ringRemove(queue, msg);
         return;
     }
 
-    // (1)
-    if (queue->head->msg == msg && queue->head == queue->tail) {
-        messageToRemove = queue->head;
-        nextMessage = NULL;
+    queueLock(queue, LOCK_SITE_REMOVE);
+    reclaimBeforeRemove(queue);
 
-        queue->head = NULL;
-        queue->tail = NULL;
+    Message *messageToRemove = queue->head;
+    while (messageToRemove != NULL && (!messageIs(messageToRemove, msg) || messageReadByAll(queue, messageToRemove))) {
+        messageToRemove = messageToRemove->next;
     }
-    // (2)
-    else if (queue->head->msg == msg) {
-        messageToRemove = queue->head;
 
-        // Detach head
-        queue->head = queue->head->next;
-        nextMessage = queue->head;
+    if (messageToRemove == NULL) {
+        TPayload *released = payloadsTake(queue);
+        queueUnlock(queue);
+        payloadsRelease(released);
+        LOG_INFO("[R] - Message for remove not found\n");
+        return;
     }
-    // (3)
-    else if (queue->tail->msg == msg) {
-        messageToRemove = queue->tail;
-        nextMessage = NULL;
 
-        // Find predecessor of tail
-        Message *tmp = queue->head;
-        while (tmp->next != queue->tail) {
-            tmp = tmp->next;
-        }
+    removeMessage(queue, messageToRemove);
+    statsAdd(&threadStats(queue)->removes, 1);
+    TPayload *released = payloadsTake(queue);
+    queueUnlock(queue);
+    payloadsRelease(released);
+    LOG_INFO("[R] - Removed message\n");
+}
+
+// Removes message published with putHandleI without search, subscribers skip it lazily like with removeI
+// Cost is O(subscribers), see removeMessage, RECLAIM_HAZARD also scans cursors first (reclaimBeforeRemove)
+// Returns 1 if message was removed, 0 if it was already read by all subscribers or removed (list engine only)
+int removeByHandleI(TQueue *queue, TMessageHandle handle) {
+    if (queue->engine == ENGINE_RING || handle.node == NULL)
+        return 0;
 
-        // Change tail
-        tmp->next = NULL;
-        queue->tail = tmp;
+    queueLock(queue, LOCK_SITE_REMOVE);
+    reclaimBeforeRemove(queue);
+    Message *node = handle.node;
+#ifdef PUBSUB_MALLOC_NODES
+    // Freed node can not be inspected, look for it in the list
+    for (node = queue->head; node != NULL && node != handle.node; node = node->next);
+#endif
+    // Pool nodes stay allocated, free and reused ones hold different sequence
+    if (node == NULL || node->seq != handle.seq || node->length == MSG_REMOVED || messageReadByAll(queue, node)) {
+        TPayload *released = payloadsTake(queue);
+        queueUnlock(queue);
+        payloadsRelease(released);
+        LOG_INFO("[R] - Message for remove not found\n");
+        return 0;
     }
-    // (4)
-    else {
-        // Find in between
-        Message *tmp = queue->head;
-        Message *previous;
-        while (tmp != NULL) {
-            if (tmp->msg == msg) {
-                break;
-            }
 
-            previous = tmp;
-            tmp = tmp->next;
-        }
+    removeMessage(queue, node);
+    statsAdd(&threadStats(queue)->removes, 1);
+    TPayload *released = payloadsTake(queue);
+    queueUnlock(queue);
+    payloadsRelease(released);
+    LOG_INFO("[R] - Removed message\n");
+    return 1;
+}
+
+void setSizeI(TQueue *queue, int size) {
+    if (size < 1) return;
+    if (queue->engine == ENGINE_RING) {
+        ringSetSize(queue, size);
+        return;
+    }
 
-        // If not found
-        if (tmp == NULL) {
-            pthread_mutex_unlock(&queue->mutex);
-            printf("[R] - Message for remove not found\n");
+    queueLock(queue, LOCK_SITE_SET_SIZE);
+
+    if (size > queue->msgMax || size >= queue->msgNumber) {
+        // Keep pool big enough for new limit
+        if (size > queue->poolSize && !poolGrow(queue, size - queue->poolSize)) {
+            queueUnlock(queue);
+            LOG_ERROR("[U] - Failed to grow message pool | Size not changed\n");
             return;
         }
-
-        messageToRemove = tmp;
-        nextMessage = messageToRemove->next;
-        previous->next = nextMessage;
+        wakePublishers(queue, size - queue->msgMax > 0 ? size - queue->msgMax : 0);
+        queue->msgMax = size;
+    } else {
+        // Remove oldest messages which do not fit in new size, reserved ones are not linked yet
+        if (queue->reclaim == RECLAIM_HAZARD)
+            hazardReclaim(queue);
+        while (queue->msgNumber > size && queue->head != NULL) {
+            dropHead(queue);
+        }
+        queue->msgMax = size;
     }
 
-    // Update subscribers next message which points to removed message
-    for (int i = 0; i < MAX_SUBS; i++) {
-        if (queue->subscribers[i].nextMsg == messageToRemove)
-            queue->subscribers[i].nextMsg = nextMessage;
+    TPayload *released = payloadsTake(queue);
+    queueUnlock(queue);
+    payloadsRelease(released);
+    LOG_INFO("[U] - Changed size of queue\n");
+}
+
+// Changes what put does when queue is full, publishers waiting for space apply new policy right away
+// Returns false if policy is not supported (ring engine only blocks)
+bool setOverflowPolicyI(TQueue *queue, QueueOverflowPolicy policy) {
+    if (queue->engine == ENGINE_RING && policy != OVERFLOW_BLOCK) {
+        LOG_ERROR("[U] - Ring engine supports only blocking overflow | Policy not changed\n");
+        return false;
     }
 
-    // Decrement queue message counter
-    queue->msgNumber -= 1;
+    queueLock(queue, LOCK_SITE_SETTINGS);
+    queue->overflowPolicy = policy;
+    if (queue->waitingPublishers > 0)
+        pthread_cond_broadcast(&queue->msgPutCall);
+    queueUnlock(queue);
+    LOG_INFO("[U] - Changed overflow policy of queue\n");
+    return true;
+}
 
-    // Delete message
-    free(messageToRemove);
-    pthread_mutex_unlock(&queue->mutex);
-    printf("[R] - Removed message\n");
+// Numbers of messages and subscribers affected by overflow policy since queue creation
+TOverflowStats getOverflowStatsI(TQueue *queue) {
+    queueLock(queue, LOCK_SITE_SETTINGS);
+    TOverflowStats stats = queue->overflowStats;
+    queueUnlock(queue);
+    return stats;
 }
 
-void setSizeI(TQueue *queue, int size) {
-    if (size < 1) return;
-    pthread_mutex_lock(&queue->mutex);
+// Sets lag limit, maxLag messages behind tail or maxLagNs with unread messages and no read (0 - no limit)
+// Subscriber over the limit is unsubscribed and its next get returns GET_LAGGED_OUT / MSG_LAGGED_OUT
+// Returns false if limit is not supported (ring engine)
+bool setMaxLagI(TQueue *queue, int maxLag, uint64_t maxLagNs) {
+    if (queue->engine == ENGINE_RING) {
+        LOG_ERROR("[U] - Ring engine does not support lag limit | Limit not changed\n");
+        return false;
+    }
 
-    int sizeDifference = 0;
-    if (size > queue->msgMax || size >= queue->msgNumber) {
-        queue->msgMax = size;
-    } else {
-        sizeDifference = queue->msgMax - size;
+    queueLock(queue, LOCK_SITE_SETTINGS);
+    queue->maxLag = maxLag > 0 ? maxLag : 0;
 
-        // Remove oldest messages
-        Message *tmp = queue->head;
-        for (int i = 0; i < sizeDifference; i++) {
-            // Check which subscriber is pointing on it
-            for (int j = 0 ; j < MAX_SUBS; j++) {
-                if (queue->subscribers[j].nextMsg == tmp) {
-                    queue->subscribers[j].nextMsg = tmp->next;
-                }
+    // Age is tracked only while limit is set, subscribers with unread messages start counting now
+    uint64_t now = monotonicNs();
+    if (maxLagNs > 0 && queue->maxLagNs == 0) {
+        for (int c = 0; c < queue->subscriberChunkCount; c++) {
+            SubscriberChunk *chunk = queue->subscriberChunks[c];
+            for (uint64_t bits = chunk->active; bits != 0; bits &= bits - 1) {
+                chunk->subs[__builtin_ctzll(bits)].lagSinceNs = now;
             }
+        }
+    }
+    queue->maxLagNs = maxLagNs;
+    queue->lagCheckNs = now + maxLagNs / 2;
+
+    // Waiting publishers recheck lag and sleep no longer than until lagCheckNs
+    if (queue->waitingPublishers > 0)
+        pthread_cond_broadcast(&queue->msgPutCall);
+    queueUnlock(queue);
+    LOG_INFO("[U] - Changed lag limit of queue\n");
+    return true;
+}
+
+// Fills snapshot of queue counters without taking mutex, calls running meanwhile may be counted partly
+// Unread messages of single subscriber are returned by getAvailableByHandleI
+void getQueueStatsI(TQueue *queue, TQueueStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < STATS_SLOTS; i++) {
+        TQueueThreadStats *slot = &queue->stats[i];
+        stats->puts += atomic_load_explicit(&slot->puts, memory_order_relaxed);
+        stats->gets += atomic_load_explicit(&slot->gets, memory_order_relaxed);
+        stats->removes += atomic_load_explicit(&slot->removes, memory_order_relaxed);
+        stats->blockedPuts += atomic_load_explicit(&slot->blockedPuts, memory_order_relaxed);
+        stats->blockedGets += atomic_load_explicit(&slot->blockedGets, memory_order_relaxed);
+        stats->blockedNs += atomic_load_explicit(&slot->blockedNs, memory_order_relaxed);
+        stats->droppedNoSubscribers += atomic_load_explicit(&slot->droppedNoSubscribers, memory_order_relaxed);
+        uint64_t depth = atomic_load_explicit(&slot->depthHighWater, memory_order_relaxed);
+        if (depth > stats->depthHighWater)
+            stats->depthHighWater = depth;
+    }
 
-            queue->msgNumber -=1;
-            queue->head = tmp->next;
-            free(tmp);
-            tmp = queue->head;
+    if (queue->engine == ENGINE_RING) {
+        ringStats(queue, stats);
+        return;
+    }
+
+    // Chunks are never freed while queue lives, odd generation marks subscribed slot
+    stats->depth = atomic_load(&queue->msgNumber);
+    uint64_t tailSeq = atomic_load(&queue->tailSeq);
+    for (int c = 0; c < SUB_CHUNKS_MAX; c++) {
+        SubscriberChunk *chunk = atomic_load(&queue->subscriberChunks[c]);
+        if (chunk == NULL)
+            break;
+
+        for (int i = 0; i < SUB_CHUNK_SIZE; i++) {
+            Subscriber *sub = &chunk->subs[i];
+            uint32_t generation = atomic_load(&sub->generation);
+            if ((generation & 1) == 0)
+                continue;
+
+            // Subscriber may read after tailSeq was loaded
+            int64_t lag = (int64_t)(tailSeq - atomic_load(&sub->readSeq) - atomic_load(&sub->skipped));
+            statsLag(stats, HANDLE_MAKE(c * SUB_CHUNK_SIZE + i, generation), lag > 0 ? (uint64_t)lag : 0);
         }
-        queue->msgMax = size;
     }
+}
+
+// Copies put to get latency histogram of subscriber, needs traced list queue (TQueueConfig::tracing)
+// and build with -DPUBSUB_TRACING, returns false otherwise or if handle is not subscribed
+bool getLatencyHistogramI(TQueue *queue, TSubscriberHandle handle, TLatencyHistogram *histogram) {
+#ifdef PUBSUB_TRACING
+    if (queue->engine == ENGINE_RING || !queue->tracing)
+        return false;
+
+    queueLock(queue, LOCK_SITE_SETTINGS);
+    int slot = handleSlot(queue, handle);
+    Subscriber *sub = subscriberAt(queue, slot);
+    bool isTraced = slot != -1 && sub->latency != NULL;
+    // Lock-free get records while it holds the cursor
+    if (isTraced && queue->reclaim == RECLAIM_HAZARD)
+        subscriberClaim(queue, sub);
+    if (isTraced)
+        *histogram = *sub->latency;
+    if (isTraced && queue->reclaim == RECLAIM_HAZARD)
+        subscriberUnclaim(queue, sub);
+    queueUnlock(queue);
+    return isTraced;
+#else
+    return false;
+#endif
+}
+
+// Latency in ns under which given percent of recorded messages was read, lowest value of its bucket
+uint64_t latencyPercentileI(const TLatencyHistogram *histogram, double percentile) {
+    uint64_t target = (uint64_t)(histogram->total * percentile / 100.0);
+    if (target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < TRACE_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= target)
+            return traceValue(i);
+    }
+    return histogram->max;
+}
 
-    printf("[U] - Changed size of queue\n");
-    pthread_mutex_unlock(&queue->mutex);
+// Prints mutex use of every lock site since queue creation, needs build with -DPUBSUB_LOCK_PROFILE
+// Hold time shows which operation keeps others waiting, wait time which one suffers from it
+void dumpLockProfileI(TQueue *queue, FILE *out) {
+#ifdef PUBSUB_LOCK_PROFILE
+    static const char *siteNames[LOCK_SITES] = {
+        [LOCK_SITE_PUT] = "put", [LOCK_SITE_RESERVE] = "reserve", [LOCK_SITE_COMMIT] = "commit",
+        [LOCK_SITE_GET] = "get", [LOCK_SITE_SUBSCRIBE] = "subscribe",
+        [LOCK_SITE_UNSUBSCRIBE] = "unsubscribe", [LOCK_SITE_FIND_HANDLE] = "find handle",
+        [LOCK_SITE_REMOVE] = "remove", [LOCK_SITE_SET_SIZE] = "set size", [LOCK_SITE_SETTINGS] = "settings",
+        [LOCK_SITE_DESTROY] = "destroy"
+    };
+
+    TLockSiteProfile profile[LOCK_SITES];
+    queueLock(queue, LOCK_SITE_SETTINGS);
+    memcpy(profile, queue->lockProfile, sizeof(profile));
+    queueUnlock(queue);
+
+    fprintf(out, "%-12s | %12s | %12s | %10s | %10s | %11s | %11s\n",
+        "lock site", "acquired", "contended", "wait ms", "hold ms", "avg hold ns", "max hold ns");
+    for (int site = 0; site < LOCK_SITES; site++) {
+        TLockSiteProfile *p = &profile[site];
+        if (p->acquisitions == 0)
+            continue;
+        fprintf(out, "%-12s | %12llu | %12llu | %10.2f | %10.2f | %11llu | %11llu\n", siteNames[site],
+            (unsigned long long)p->acquisitions, (unsigned long long)p->contended, p->waitNs / 1e6,
+            p->holdNs / 1e6, (unsigned long long)(p->holdNs / p->acquisitions), (unsigned long long)p->maxHoldNs);
+    }
+#else
+    fprintf(out, "Lock profile needs build with -DPUBSUB_LOCK_PROFILE\n");
+#endif
 }
@@ -0,0 +1,572 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "structures.h"
+#include "logger.h"
+
+// Broadcast ring (Disruptor style)
+// Publishers claim sequences with single atomic add and publish by stamping slot,
+// every subscriber owns its read cursor, so get path never touches queue mutex.
+// Mutex is used only for structural operations (subscribe, unsubscribe, remove, set size).
+// Slot with sequence S can be reused only when all cursors passed S, which replaces
+// per-message receivers counter - message is delivered to subscribers present at claim time.
+
+// -= Queue (pubSubInterface.c) =-
+bool waitBackoff(TQueue *queue, int *spins);
+uint64_t monotonicNs();
+TQueueThreadStats *threadStats(TQueue *queue);
+void statsAdd(_Atomic uint64_t *counter, uint64_t value);
+void statsDepth(TQueue *queue, uint64_t depth);
+void statsBlocked(TQueue *queue, bool isPut, uint64_t since);
+void statsLag(TQueueStats *stats, TSubscriberHandle handle, uint64_t lag);
+void queueLock(TQueue *queue, QueueLockSite site);
+void queueUnlock(TQueue *queue);
+
+#ifndef PUBSUB_PACKED_LAYOUT
+_Static_assert(sizeof(RingCursor) == CACHE_LINE, "RingCursor must fill exactly one cache line");
+_Static_assert(offsetof(RingBuffer, cursors) % CACHE_LINE == 0, "RingBuffer cursors share cache line with management section");
+_Static_assert(offsetof(RingBuffer, claimSeq) / CACHE_LINE != offsetof(RingBuffer, publishEvent) / CACHE_LINE,
+    "RingBuffer claim and wake-up sections share cache line");
+#endif
+
+
+static char ringTombstone;
+#define RING_TOMBSTONE ((void *)&ringTombstone) // Marks message removed by removeI
+
+
+// -= Futex helpers =-
+// Timeout is relative, NULL waits without limit
+static void futexWait(_Atomic uint32_t *word, uint32_t expected, const struct timespec *timeout) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0);
+}
+
+static void futexWake(_Atomic uint32_t *word) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// Wake parked threads only if there are any, keeps hot path free of syscalls
+static void ringNotify(_Atomic uint32_t *event, _Atomic int *parked) {
+    if (atomic_load(parked) > 0) {
+        atomic_fetch_add(event, 1);
+        futexWake(event);
+    }
+}
+
+static void ringWakeAll(_Atomic uint32_t *event) {
+    atomic_fetch_add(event, 1);
+    futexWake(event);
+}
+
+
+// -= Supportive functions =-
+static uint64_t ringMinCursor(RingBuffer *ring, uint64_t limit) {
+    uint64_t min = limit;
+    uint64_t gate = atomic_load(&ring->removeGate);
+    if (gate < min) min = gate;
+
+    for (int i = 0; i < MAX_SUBS; i++) {
+        if (atomic_load(&ring->cursors[i].active)) {
+            uint64_t cursor = atomic_load(&ring->cursors[i].cursor);
+            if (cursor < min) min = cursor;
+        }
+    }
+    return min;
+}
+
+// Checks whether sequence fits in msgMax window behind the slowest subscriber
+static bool ringHasCapacity(RingBuffer *ring, uint64_t seq) {
+    int msgMax = atomic_load(&ring->msgMax);
+    if ((int64_t)(seq - atomic_load(&ring->gatingSeq)) < msgMax)
+        return true;
+
+    uint64_t min = ringMinCursor(ring, seq);
+    atomic_store(&ring->gatingSeq, min);
+    return (int64_t)(seq - min) < msgMax;
+}
+
+// Free slots for claim at sequence, cached gating cursor is refreshed only when it shows less than wanted
+static int64_t ringSpace(RingBuffer *ring, uint64_t claimed, int wanted) {
+    int64_t space = atomic_load(&ring->msgMax) - (int64_t)(claimed - atomic_load(&ring->gatingSeq));
+    if (space >= wanted)
+        return space;
+
+    uint64_t min = ringMinCursor(ring, claimed);
+    atomic_store(&ring->gatingSeq, min);
+    return atomic_load(&ring->msgMax) - (int64_t)(claimed - min);
+}
+
+// Computes time left to absolute CLOCK_MONOTONIC deadline, returns false if it already passed
+static bool ringTimeLeft(const struct timespec *deadline, struct timespec *left) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    left->tv_sec = deadline->tv_sec - now.tv_sec;
+    left->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+    if (left->tv_nsec < 0) {
+        left->tv_sec -= 1;
+        left->tv_nsec += 1000000000L;
+    }
+    return left->tv_sec >= 0 && (left->tv_sec > 0 || left->tv_nsec > 0);
+}
+
+// Returns cursor of handle or NULL if handle is stale
+static RingCursor *ringHandleCursor(RingBuffer *ring, TSubscriberHandle handle) {
+    int slot = HANDLE_SLOT(handle);
+    if (slot < 0 || slot >= MAX_SUBS)
+        return NULL;
+
+    RingCursor *cursor = &ring->cursors[slot];
+    if (!atomic_load(&cursor->active) || atomic_load(&cursor->generation) != HANDLE_GENERATION(handle))
+        return NULL;
+    return cursor;
+}
+
+static bool ringIsSubscribed(RingCursor *cursor, TSubscriberHandle handle) {
+    return atomic_load(&cursor->active) && atomic_load(&cursor->generation) == HANDLE_GENERATION(handle);
+}
+
+
+// -= Engine functions =-
+bool ringCreate(TQueue *queue, int size, int capacity) {
+    int slots = 1;
+    while (slots < size || slots < capacity)
+        slots <<= 1;
+
+    RingBuffer *ring = aligned_alloc(CACHE_LINE, sizeof(RingBuffer));
+    if (ring == NULL)
+        return false;
+
+    ring->slots = malloc(sizeof(RingSlot) * slots);
+    if (ring->slots == NULL) {
+        free(ring);
+        return false;
+    }
+
+    for (int i = 0; i < slots; i++) {
+        atomic_init(&ring->slots[i].stamp, 0);
+        atomic_init(&ring->slots[i].msg, NULL);
+    }
+    ring->capacity = slots;
+    ring->mask = slots - 1;
+
+    atomic_init(&ring->claimSeq, 0);
+    atomic_init(&ring->gatingSeq, 0);
+    atomic_init(&ring->removeGate, UINT64_MAX);
+    atomic_init(&ring->msgMax, size);
+    atomic_init(&ring->publishEvent, 0);
+    atomic_init(&ring->consumeEvent, 0);
+    atomic_init(&ring->parkedSubscribers, 0);
+    atomic_init(&ring->parkedPublishers, 0);
+    atomic_init(&ring->exitFlag, false);
+    atomic_init(&ring->activePublishers, 0);
+    atomic_init(&ring->activeSubscribers, 0);
+    atomic_init(&ring->subscribersNumber, 0);
+
+    for (int i = 0; i < MAX_SUBS; i++) {
+        atomic_init(&ring->cursors[i].cursor, 0);
+        atomic_init(&ring->cursors[i].threadId, 0);
+        atomic_init(&ring->cursors[i].generation, 0);
+        atomic_init(&ring->cursors[i].active, false);
+    }
+
+    queue->ring = ring;
+    return true;
+}
+
+void ringDestroy(TQueue *queue) {
+    RingBuffer *ring = queue->ring;
+    atomic_store(&ring->exitFlag, true);
+
+    // Same order as list engine - publishers first, then subscribers
+    while (atomic_load(&ring->activePublishers) != 0) {
+        ringWakeAll(&ring->consumeEvent);
+        sched_yield();
+    }
+    LOG_INFO("[D] - Removed all waiting publishers\n");
+
+    while (atomic_load(&ring->activeSubscribers) != 0) {
+        ringWakeAll(&ring->publishEvent);
+        sched_yield();
+    }
+    LOG_INFO("[D] - Removed all waiting subscribers\n");
+
+    free(ring->slots);
+    free(ring);
+    queue->ring = NULL;
+}
+
+TSubscriberHandle ringFindHandle(TQueue *queue, pthread_t thread) {
+    RingBuffer *ring = queue->ring;
+    for (int i = 0; i < MAX_SUBS; i++) {
+        RingCursor *cursor = &ring->cursors[i];
+        if (atomic_load(&cursor->active) && atomic_load(&cursor->threadId) == thread)
+            return HANDLE_MAKE(i, atomic_load(&cursor->generation));
+    }
+    return 0;
+}
+
+TSubscriberHandle ringSubscribe(TQueue *queue, pthread_t thread) {
+    RingBuffer *ring = queue->ring;
+    queueLock(queue, LOCK_SITE_SUBSCRIBE);
+    for (int i = 0; i < MAX_SUBS; i++) {
+        RingCursor *cursor = &ring->cursors[i];
+        if (!atomic_load(&cursor->active)) {
+            uint32_t generation = atomic_load(&cursor->generation) + 1;
+            atomic_store(&cursor->generation, generation);
+            atomic_store(&cursor->threadId, thread);
+            atomic_store(&cursor->cursor, atomic_load(&ring->claimSeq));
+            atomic_store(&cursor->active, true);
+            // Publishers which checked capacity before activation did not see this cursor,
+            // so start after everything claimed so far
+            atomic_store(&cursor->cursor, atomic_load(&ring->claimSeq));
+            atomic_fetch_add(&ring->subscribersNumber, 1);
+            atomic_fetch_add(&queue->subscriptionsVersion, 1);
+            queueUnlock(queue);
+            LOG_INFO("[S] - Thread subscribed to queue\n");
+            return HANDLE_MAKE(i, generation);
+        }
+    }
+    queueUnlock(queue);
+    LOG_ERROR("[S] - Thread failed while subscribing to queue\n");
+    return 0;
+}
+
+void ringUnsubscribe(TQueue *queue, TSubscriberHandle handle) {
+    RingBuffer *ring = queue->ring;
+    queueLock(queue, LOCK_SITE_UNSUBSCRIBE);
+
+    RingCursor *cursor = ringHandleCursor(ring, handle);
+    if (cursor != NULL) {
+        atomic_store(&cursor->active, false);
+        atomic_store(&cursor->threadId, 0);
+        atomic_fetch_sub(&ring->subscribersNumber, 1);
+        atomic_fetch_add(&queue->subscriptionsVersion, 1);
+    }
+    queueUnlock(queue);
+
+    // Gating cursor is gone and waiting getI has to notice it
+    ringWakeAll(&ring->consumeEvent);
+    ringWakeAll(&ring->publishEvent);
+}
+
+// Claims as much of the batch as fits behind the slowest subscriber with one atomic compare-and-swap
+// Waits for at least one free slot until deadline (NULL waits without limit)
+// Returns number of published messages, 0 on timeout or -1 if queue is being destroyed
+int ringPutBatch(TQueue *queue, void **msgs, int n, const struct timespec *deadline) {
+    RingBuffer *ring = queue->ring;
+    // Counted before exit flag is checked, so ringDestroy either sees this thread or this thread sees the flag
+    atomic_fetch_add(&ring->activePublishers, 1);
+    if (atomic_load(&ring->exitFlag)) {
+        atomic_fetch_sub(&ring->activePublishers, 1);
+        return -1;
+    }
+
+    if (atomic_load(&ring->subscribersNumber) == 0) {
+        statsAdd(&threadStats(queue)->droppedNoSubscribers, n);
+        atomic_fetch_sub(&ring->activePublishers, 1);
+        return n;
+    }
+
+    // Claim sequences - only contended write of publishers
+    uint64_t first;
+    uint64_t blockedSince = 0;
+    int spins = 0;
+    while (true) {
+        if (atomic_load(&ring->exitFlag)) {
+            statsBlocked(queue, true, blockedSince);
+            atomic_fetch_sub(&ring->activePublishers, 1);
+            return -1;
+        }
+
+        uint64_t claimed = atomic_load(&ring->claimSeq);
+        int64_t space = ringSpace(ring, claimed, n);
+        if (space > 0) {
+            int count = n < space ? n : (int)space;
+            if (atomic_compare_exchange_weak(&ring->claimSeq, &claimed, claimed + count)) {
+                first = claimed;
+                n = count;
+                // Cached gating cursor may lag behind, depth is never shown above msgMax
+                int64_t depth = atomic_load(&ring->msgMax) - space + count;
+                statsDepth(queue, depth);
+                break;
+            }
+            continue;
+        }
+
+        struct timespec left;
+        if (deadline != NULL && !ringTimeLeft(deadline, &left)) {
+            statsBlocked(queue, true, blockedSince);
+            atomic_fetch_sub(&ring->activePublishers, 1);
+            return 0;
+        }
+        if (blockedSince == 0)
+            blockedSince = monotonicNs();
+
+        if (waitBackoff(queue, &spins))
+            continue;
+
+        atomic_fetch_add(&ring->parkedPublishers, 1);
+        uint32_t seen = atomic_load(&ring->consumeEvent);
+        if (ringSpace(ring, atomic_load(&ring->claimSeq), 1) <= 0 && !atomic_load(&ring->exitFlag))
+            futexWait(&ring->consumeEvent, seen, deadline != NULL ? &left : NULL);
+        atomic_fetch_sub(&ring->parkedPublishers, 1);
+    }
+
+    for (int i = 0; i < n; i++) {
+        uint64_t seq = first + i;
+
+        // Claimed space can shrink only by setSizeI, then wait behind the slowest subscriber
+        spins = 0;
+        while (!ringHasCapacity(ring, seq)) {
+            if (atomic_load(&ring->exitFlag)) {
+                statsBlocked(queue, true, blockedSince);
+                atomic_fetch_sub(&ring->activePublishers, 1);
+                return -1;
+            }
+            if (blockedSince == 0)
+                blockedSince = monotonicNs();
+
+            if (waitBackoff(queue, &spins))
+                continue;
+
+            // Already published part of batch must be visible before parking
+            ringNotify(&ring->publishEvent, &ring->parkedSubscribers);
+            atomic_fetch_add(&ring->parkedPublishers, 1);
+            uint32_t seen = atomic_load(&ring->consumeEvent);
+            if (!ringHasCapacity(ring, seq) && !atomic_load(&ring->exitFlag))
+                futexWait(&ring->consumeEvent, seen, NULL);
+            atomic_fetch_sub(&ring->parkedPublishers, 1);
+        }
+
+        // Publish
+        RingSlot *slot = &ring->slots[seq & ring->mask];
+        atomic_store(&slot->msg, msgs[i]);
+        atomic_store(&slot->stamp, seq + 1);
+    }
+
+    ringNotify(&ring->publishEvent, &ring->parkedSubscribers);
+    statsAdd(&threadStats(queue)->puts, n);
+    statsBlocked(queue, true, blockedSince);
+    atomic_fetch_sub(&ring->activePublishers, 1);
+    return n;
+}
+
+// Reads up to max messages once at least minCount are published or deadline (may be NULL) passed
+// Returns number of read messages or -1 if queue is destroyed or handle is not subscribed
+int ringGetBatch(TQueue *queue, TSubscriberHandle handle, void **out, int max, int minCount, const struct timespec *deadline) {
+    RingBuffer *ring = queue->ring;
+    // Counted before exit flag is checked, so ringDestroy either sees this thread or this thread sees the flag
+    atomic_fetch_add(&ring->activeSubscribers, 1);
+    if (atomic_load(&ring->exitFlag)) {
+        atomic_fetch_sub(&ring->activeSubscribers, 1);
+        return -1;
+    }
+
+    RingCursor *cursor = ringHandleCursor(ring, handle);
+    if (cursor == NULL) {
+        atomic_fetch_sub(&ring->activeSubscribers, 1);
+        LOG_INFO("[S] - Thread is no longer subscribed | Returning NULL\n");
+        return -1;
+    }
+
+    // Waiting for more than fits in the ring would never end
+    if (minCount > atomic_load(&ring->msgMax))
+        minCount = atomic_load(&ring->msgMax);
+
+    uint64_t blockedSince = 0;
+    int spins = 0;
+    while (true) {
+        if (atomic_load(&ring->exitFlag)) {
+            statsBlocked(queue, false, blockedSince);
+            atomic_fetch_sub(&ring->activeSubscribers, 1);
+            return -1;
+        }
+
+        if (!ringIsSubscribed(cursor, handle)) {
+            statsBlocked(queue, false, blockedSince);
+            atomic_fetch_sub(&ring->activeSubscribers, 1);
+            LOG_INFO("[S] - Thread is no longer subscribed | Returning NULL\n");
+            return -1;
+        }
+
+        // Count published messages after cursor
+        uint64_t seq = atomic_load(&cursor->cursor);
+        uint64_t claimed = atomic_load(&ring->claimSeq);
+        int ready = 0;
+        while (
+            ready < max && seq + ready < claimed &&
+            atomic_load(&ring->slots[(seq + ready) & ring->mask].stamp) == seq + ready + 1
+        )
+            ready++;
+
+        struct timespec left;
+        bool isExpired = deadline != NULL && !ringTimeLeft(deadline, &left);
+
+        if (ready > 0 && (ready >= minCount || isExpired)) {
+            int count = 0;
+            for (int i = 0; i < ready; i++) {
+                void *msg = atomic_load(&ring->slots[(seq + i) & ring->mask].msg);
+                if (msg != RING_TOMBSTONE)
+                    out[count++] = msg;
+            }
+
+            // Cursor can be moved by setSizeI, then slot content is not guaranteed
+            if (!atomic_compare_exchange_strong(&cursor->cursor, &seq, seq + ready))
+                continue;
+
+            // Unsubscribed cursor does not gate publishers, read could be overwritten
+            if (!ringIsSubscribed(cursor, handle))
+                continue;
+
+            ringNotify(&ring->consumeEvent, &ring->parkedPublishers);
+            if (count == 0)
+                continue;
+
+            statsAdd(&threadStats(queue)->gets, count);
+            statsBlocked(queue, false, blockedSince);
+            atomic_fetch_sub(&ring->activeSubscribers, 1);
+            return count;
+        }
+
+        if (isExpired) {
+            statsBlocked(queue, false, blockedSince);
+            atomic_fetch_sub(&ring->activeSubscribers, 1);
+            return 0;
+        }
+        if (blockedSince == 0)
+            blockedSince = monotonicNs();
+
+        if (waitBackoff(queue, &spins))
+            continue;
+
+        RingSlot *slot = &ring->slots[(seq + ready) & ring->mask];
+        atomic_fetch_add(&ring->parkedSubscribers, 1);
+        uint32_t seen = atomic_load(&ring->publishEvent);
+        if (
+            atomic_load(&slot->stamp) != seq + ready + 1 &&
+            atomic_load(&cursor->cursor) == seq &&
+            ringIsSubscribed(cursor, handle) &&
+            !atomic_load(&ring->exitFlag)
+        )
+            futexWait(&ring->publishEvent, seen, deadline != NULL ? &left : NULL);
+        atomic_fetch_sub(&ring->parkedSubscribers, 1);
+    }
+}
+
+int ringGetAvailable(TQueue *queue, TSubscriberHandle handle) {
+    RingBuffer *ring = queue->ring;
+    RingCursor *cursor = ringHandleCursor(ring, handle);
+    if (cursor == NULL)
+        return 0;
+
+    // Count published messages starting from cursor
+    uint64_t seq = atomic_load(&cursor->cursor);
+    uint64_t claimed = atomic_load(&ring->claimSeq);
+    int unreadMessages = 0;
+    while (seq < claimed) {
+        RingSlot *slot = &ring->slots[seq & ring->mask];
+        if (atomic_load(&slot->stamp) != seq + 1)
+            break;
+        if (atomic_load(&slot->msg) != RING_TOMBSTONE)
+            unreadMessages++;
+        seq++;
+    }
+    return unreadMessages;
+}
+
+uint64_t ringGetReadSeq(TQueue *queue, TSubscriberHandle handle) {
+    RingCursor *cursor = ringHandleCursor(queue->ring, handle);
+    return cursor != NULL ? atomic_load(&cursor->cursor) : 0;
+}
+
+void ringRemove(TQueue *queue, void *msg) {
+    RingBuffer *ring = queue->ring;
+    queueLock(queue, LOCK_SITE_REMOVE);
+
+    // Hold slowest cursor position, so publishers cannot reuse slots during search
+    uint64_t claimed = atomic_load(&ring->claimSeq);
+    uint64_t gate = ringMinCursor(ring, claimed);
+    atomic_store(&ring->removeGate, gate);
+
+    bool isRemoved = false;
+    for (uint64_t seq = gate; seq < claimed && !isRemoved; seq++) {
+        RingSlot *slot = &ring->slots[seq & ring->mask];
+        if (atomic_load(&slot->stamp) != seq + 1)
+            continue;
+
+        void *expected = msg;
+        isRemoved = atomic_compare_exchange_strong(&slot->msg, &expected, RING_TOMBSTONE);
+    }
+
+    atomic_store(&ring->removeGate, UINT64_MAX);
+    if (isRemoved)
+        statsAdd(&threadStats(queue)->removes, 1);
+    queueUnlock(queue);
+    ringWakeAll(&ring->consumeEvent);
+
+    if (isRemoved)
+        LOG_INFO("[R] - Removed message\n");
+    else
+        LOG_INFO("[R] - Message for remove not found\n");
+}
+
+void ringSetSize(TQueue *queue, int size) {
+    RingBuffer *ring = queue->ring;
+    queueLock(queue, LOCK_SITE_SET_SIZE);
+
+    bool isLimited = size > ring->capacity;
+    if (isLimited)
+        size = ring->capacity;
+
+    // Move lagging cursors forward, oldest messages are dropped for them
+    uint64_t claimed = atomic_load(&ring->claimSeq);
+    if (claimed > (uint64_t)size) {
+        for (int i = 0; i < MAX_SUBS; i++) {
+            RingCursor *cursor = &ring->cursors[i];
+            if (!atomic_load(&cursor->active))
+                continue;
+
+            uint64_t seq = atomic_load(&cursor->cursor);
+            while (seq < claimed - size) {
+                if (atomic_compare_exchange_strong(&cursor->cursor, &seq, claimed - size))
+                    break;
+            }
+        }
+    }
+
+    atomic_store(&ring->msgMax, size);
+    queue->msgMax = size;
+
+    queueUnlock(queue);
+    ringWakeAll(&ring->consumeEvent);
+
+    if (isLimited)
+        LOG_INFO("[U] - Size exceeds ring capacity | Limiting to %d\n", ring->capacity);
+    LOG_INFO("[U] - Changed size of queue\n");
+}
+
+// Fills depth and subscriber lag of getQueueStatsI snapshot, lock-free like get
+void ringStats(TQueue *queue, TQueueStats *stats) {
+    RingBuffer *ring = queue->ring;
+    uint64_t claimed = atomic_load(&ring->claimSeq);
+    stats->depth = (int)(claimed - ringMinCursor(ring, claimed));
+
+    for (int i = 0; i < MAX_SUBS; i++) {
+        RingCursor *cursor = &ring->cursors[i];
+        if (!atomic_load(&cursor->active))
+            continue;
+
+        // Cursor may pass claimed sequence loaded above
+        int64_t lag = (int64_t)(claimed - atomic_load(&cursor->cursor));
+        statsLag(stats, HANDLE_MAKE(i, atomic_load(&cursor->generation)), lag > 0 ? (uint64_t)lag : 0);
+    }
+}
@@ -1,37 +1,384 @@
 #pragma once
 
-#define MAX_SUBS 50 // Max number of subscribers
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
+#define CACHE_LINE 64
+
+// Sections written by different threads start on their own cache line
+// Build with -DPUBSUB_PACKED_LAYOUT to drop the alignment (benchmark comparison)
+#ifdef PUBSUB_PACKED_LAYOUT
+#define CACHE_ALIGNED
+#else
+#define CACHE_ALIGNED _Alignas(CACHE_LINE)
+#endif
+
+#define MAX_SUBS 50 // Max number of ring engine subscribers
+#define SUB_CHUNK_SIZE 64 // Subscribers per chunk of list engine table (one bitmap word)
+#define SUB_CHUNKS_MAX 1024 // List engine takes up to SUB_CHUNK_SIZE * SUB_CHUNKS_MAX subscribers
+
+// Build with -DPUBSUB_TRACING to stamp messages at enqueue and keep latency histogram of every subscriber
+// (TQueueConfig::tracing), timestamp takes 8 bytes of inline payload so node stays one cache line
+#ifndef MSG_INLINE_SIZE
+#ifdef PUBSUB_TRACING
+#define MSG_INLINE_SIZE 32
+#else
+#define MSG_INLINE_SIZE 40 // putCopyI payloads up to this size are stored in the node, default fills one cache line
+#endif
+#endif
+#define MSG_POINTER -1 // Message::length of message put by pointer (putI)
+#define MSG_PAYLOAD -2 // Message::length of message put with putPayloadI, msg points to TPayload
+#define MSG_REMOVED -3 // Message::length of removed message left in list until subscribers pass it
+#define MSG_SEQ_FREE UINT64_MAX // Message::seq of free or reserved node, matches no message handle
+
+// Returned by get calls which return pointers for message published with putCopyI, read it with getCopyI
+extern char msgCopiedMarker;
+#define MSG_COPIED ((void *)&msgCopiedMarker)
+
+// Returned by pointer get calls (GET_LAGGED_OUT by counting ones) after subscriber was unsubscribed for lag
+extern char msgLaggedOutMarker;
+#define MSG_LAGGED_OUT ((void *)&msgLaggedOutMarker)
+#define GET_LAGGED_OUT -2
+
+// Reference counted payload, handed to queue without copying (putPayloadI)
+// Every message holding it and every subscriber which got it owns one reference,
+// release is called once, by whoever drops the last one
+typedef struct TPayload {
+    _Atomic int refs;
+    void (*release)(struct TPayload *payload); // called when refs drop to zero, never with queue mutex held
+    void *context; // user data for release (publisher pool, ...)
+    void *data;
+    int length;
+    struct TPayload *nextReleased; // links payloads released under queue mutex until it is unlocked
+} TPayload;
+
+// Header and inline payload share cache line, so subscriber reads copied message with one miss
 typedef struct Message {
-    int receivers;
-    void *msg;
+    CACHE_ALIGNED uint64_t seq; // position in queue, increasing by one for each put
     struct Message *next;
+    int receivers; // RECLAIM_RECEIVERS only
+    int length; // MSG_POINTER, MSG_PAYLOAD or size of payload copied by putCopyI
+#ifdef PUBSUB_TRACING
+    uint64_t putNs; // CLOCK_MONOTONIC time of enqueue
+#endif
+    union {
+        void *msg; // published pointer, TPayload, or pooled buffer with copied payload longer than MSG_INLINE_SIZE
+        char data[MSG_INLINE_SIZE]; // copied payload up to MSG_INLINE_SIZE
+    };
 } Message;
 
+// Message reserved by reservePutI, publisher writes length bytes into data and commits it with commitPutI
+typedef struct {
+    void *data; // NULL if reservation failed
+    int length;
+    Message *node;
+} TPutSlot;
+
+// Message published with putHandleI, removable with removeByHandleI
+// Handle is valid while node holds message seq, node NULL marks message which was not published
+typedef struct {
+    Message *node;
+    uint64_t seq;
+} TMessageHandle;
+
+// Block of preallocated Message nodes, released only when queue is destroyed
+typedef struct MessageChunk {
+    struct MessageChunk *next;
+    int size;
+    Message nodes[];
+} MessageChunk;
+
+#define BUFFER_MIN_SIZE 64 // smallest pooled payload buffer
+#define BUFFER_CLASSES 11  // power of two size classes from BUFFER_MIN_SIZE, larger payloads use malloc
+
+// Log-linear (HDR style) histogram of nanoseconds, every power of two is split into 2^TRACE_SUB_BITS buckets,
+// so recorded value is within ~6% of real one, values from 2^TRACE_MAGNITUDES ns go to the last bucket
+#define TRACE_SUB_BITS 4
+#define TRACE_MAGNITUDES 40
+#define TRACE_BUCKETS ((TRACE_MAGNITUDES - TRACE_SUB_BITS + 1) << TRACE_SUB_BITS)
+
+typedef struct {
+    uint64_t counts[TRACE_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} TLatencyHistogram;
+
+// Opaque subscriber handle returned by subscribeI, 0 is never valid
+// Low 32 bits hold slot index + 1, high 32 bits hold slot generation
+typedef uint64_t TSubscriberHandle;
+#define HANDLE_MAKE(slot, generation) (((uint64_t)(generation) << 32) | (uint32_t)((slot) + 1))
+#define HANDLE_SLOT(handle) ((int)((handle) & 0xffffffffu) - 1)
+#define HANDLE_GENERATION(handle) ((uint32_t)((handle) >> 32))
+
+// Every slot starts on its own cache line, readSeq written by one subscriber does not invalidate its neighbours
 typedef struct {
-    pthread_t threadId;
-    Message *nextMsg;
+    CACHE_ALIGNED pthread_t threadId;
+    _Atomic uint32_t generation; // incremented on subscribe and unsubscribe, invalidates old handles
+    Message *nextMsg; // RECLAIM_HAZARD: read tail is kept marked as passed, see Hazard cursors
+    _Atomic int claimed; // RECLAIM_HAZARD, cursor is owned by lock-free get or by mutex holder moving it
+    _Atomic uint64_t readSeq; // sequence of next message to read
+    _Atomic uint64_t skipped; // messages removed before subscriber reached them
+    pthread_cond_t msgGetCall; // condition variable on which getI of this slot waits
+    int waiting; // number of threads waiting on msgGetCall of this slot
+    uint64_t wakeSeq; // waiting threads are woken once tailSeq reaches it
+    uint64_t lagSinceNs; // has unread messages and did not read since, maintained only with age lag limit
+                         // 0 - RECLAIM_HAZARD reader caught up, clock starts at next lag check
+    uint32_t laggedOut; // generation of handle which was unsubscribed for lag
+#ifdef PUBSUB_TRACING
+    TLatencyHistogram *latency; // put to get time of read messages, allocated on first subscribe of traced queue
+#endif
 } Subscriber;
 
+// Part of growable subscriber table, chunks are never moved so subscriber addresses stay valid
+// Bit i of each bitmap describes subs[i]
 typedef struct {
-    // Pthread section
-    pthread_mutex_t mutex;
-    pthread_cond_t msgGetCall;
-    pthread_cond_t msgPutCall;
+    uint64_t active;  // slot is subscribed
+    uint64_t idle;    // subscriber read everything (nextMsg is NULL), next put sets its cursor
+    uint64_t waiters; // some thread waits on msgGetCall of slot
+    Subscriber subs[SUB_CHUNK_SIZE]; // first slot starts on next cache line
+} SubscriberChunk;
+
+// Storage engine of the queue, chosen at createQueueConfigI time
+typedef enum {
+    ENGINE_LIST = 0, // linked list of Message nodes guarded by queue mutex
+    ENGINE_RING = 1  // lock-free broadcast ring, see ringEngine.c
+} QueueEngine;
+
+// How blocked put/get waits for space or messages
+typedef enum {
+    WAIT_DEFAULT = 0,    // engine default, list parks, ring spins then parks
+    WAIT_PARK = 1,       // sleep on condition variable / futex right away
+    WAIT_SPIN = 2,       // busy-spin, never sleep (consumer pinned to its own core)
+    WAIT_SPIN_YIELD = 3, // busy-spin spinLimit times, then keep yielding the CPU
+    WAIT_SPIN_PARK = 4   // busy-spin spinLimit times, then sleep
+} QueueWaitStrategy;
+
+#define WAIT_SPIN_LIMIT 1000 // default number of busy-spin iterations
+
+// What put does when queue holds msgMax messages (list engine, ring always blocks)
+typedef enum {
+    OVERFLOW_BLOCK = 0,         // wait for free space
+    OVERFLOW_DROP_OLDEST = 1,   // drop oldest message, subscribers which did not read it skip it
+    OVERFLOW_DROP_NEWEST = 2,   // drop the message being put
+    OVERFLOW_EVICT_SLOWEST = 3  // unsubscribe subscriber with the most unread messages
+} QueueOverflowPolicy;
+
+// How list engine finds messages read by all subscribers
+typedef enum {
+    RECLAIM_RECEIVERS = 0, // every read decrements Message::receivers, unsubscribe walks unread messages
+    RECLAIM_MIN_CURSOR = 1, // messages before the lowest subscriber cursor are freed, reads do not write messages
+    RECLAIM_HAZARD = 2 // cursors are hazard pointers, get reads without mutex, publishers free messages behind them
+} QueueReclaim;
+
+// Counters of messages and subscribers affected by overflow policy
+typedef struct {
+    uint64_t droppedOldest;
+    uint64_t droppedNewest;
+    uint64_t evictedSubscribers;
+    uint64_t laggedOutSubscribers; // unsubscribed for exceeding lag limit
+} TOverflowStats;
+
+#define STATS_SLOTS 16 // counter slots per queue, threads beyond it share slots (power of two)
+
+// Counters of threads mapped to one slot, kept on its own cache line
+typedef struct {
+    CACHE_ALIGNED _Atomic uint64_t puts;
+    _Atomic uint64_t gets; // messages read, each subscriber counts its own
+    _Atomic uint64_t removes;
+    _Atomic uint64_t blockedPuts; // put calls which waited for space
+    _Atomic uint64_t blockedGets; // get calls which waited for messages
+    _Atomic uint64_t blockedNs; // time spent waiting by both
+    _Atomic uint64_t droppedNoSubscribers;
+    _Atomic uint64_t depthHighWater; // most messages in queue seen by put of the slot
+} TQueueThreadStats;
+
+// Snapshot filled by getQueueStatsI
+typedef struct {
+    uint64_t puts;
+    uint64_t gets;
+    uint64_t removes;
+    uint64_t blockedPuts;
+    uint64_t blockedGets;
+    uint64_t blockedNs;
+    uint64_t droppedNoSubscribers;
+    uint64_t depthHighWater;
+    int depth; // messages in queue at snapshot time
+    int subscribers;
+    uint64_t maxSubscriberLag; // unread messages of the slowest subscriber
+    uint64_t totalSubscriberLag;
+    TSubscriberHandle slowestSubscriber; // 0 if there is no subscriber
+} TQueueStats;
+
+// Operations taking queue mutex, build with -DPUBSUB_LOCK_PROFILE to profile them (dumpLockProfileI)
+typedef enum {
+    LOCK_SITE_PUT = 0,     // put calls, including wait for space
+    LOCK_SITE_RESERVE,     // reservePutI
+    LOCK_SITE_COMMIT,      // commitPutI, abortPutI
+    LOCK_SITE_GET,         // get calls, including wait for messages
+    LOCK_SITE_SUBSCRIBE,
+    LOCK_SITE_UNSUBSCRIBE,
+    LOCK_SITE_FIND_HANDLE, // pthread_t interfaces resolving handle
+    LOCK_SITE_REMOVE,      // removeI, removeByHandleI
+    LOCK_SITE_SET_SIZE,
+    LOCK_SITE_SETTINGS,    // overflow policy, lag limit, stats and histogram calls
+    LOCK_SITE_DESTROY,
+    LOCK_SITES
+} QueueLockSite;
+
+// Mutex use of one lock site, times in ns, hold time stops while thread waits on condition variable
+typedef struct {
+    uint64_t acquisitions;
+    uint64_t contended; // mutex was locked by other thread
+    uint64_t waitNs;
+    uint64_t holdNs;
+    uint64_t maxHoldNs;
+} TLockSiteProfile;
+
+typedef struct {
+    QueueEngine engine;
+    int ringCapacity; // ring only, slots reserved for setSizeI growth (0 - smallest power of two >= size)
+    QueueWaitStrategy wait;
+    int spinLimit; // 0 - WAIT_SPIN_LIMIT
+    QueueOverflowPolicy overflow;
+    int maxLag; // list only, unsubscribe subscriber more than maxLag messages behind tail (0 - no limit)
+    uint64_t maxLagNs; // list only, unsubscribe subscriber which keeps unread messages longer (0 - no limit)
+    bool tracing; // list only, needs -DPUBSUB_TRACING, record put to get latency of every subscriber
+    QueueReclaim reclaim; // list only, ring always frees behind the lowest cursor
+} TQueueConfig;
+
+// Single ring slot, stamp holds sequence + 1 once message is published
+typedef struct {
+    _Atomic uint64_t stamp;
+    _Atomic(void *) msg;
+} RingSlot;
+
+// Read cursor of one subscriber, kept on its own cache line
+typedef struct {
+    _Atomic uint64_t cursor;
+    _Atomic pthread_t threadId;
+    _Atomic uint32_t generation;
+    _Atomic bool active;
+    char padding[CACHE_LINE - 2 * sizeof(uint64_t) - sizeof(uint32_t) - sizeof(bool)];
+} RingCursor;
+
+// Allocated with aligned_alloc, sections are kept on separate cache lines
+typedef struct {
+    RingSlot *slots;
+    uint64_t mask;
+    int capacity;
+
+    // Publisher side
+    CACHE_ALIGNED _Atomic uint64_t claimSeq;   // next sequence to claim
+    _Atomic uint64_t gatingSeq;  // cached minimum of subscriber cursors
+    _Atomic uint64_t removeGate; // extra gating cursor held by removeI (UINT64_MAX if unused)
+    _Atomic int msgMax;
+
+    // Wake-up section (futex words)
+    CACHE_ALIGNED _Atomic uint32_t publishEvent;
+    _Atomic uint32_t consumeEvent;
+    _Atomic int parkedSubscribers;
+    _Atomic int parkedPublishers;
 
     // Management section
-    int msgMax;
-    int msgNumber;
-    bool exitFlag;
+    CACHE_ALIGNED _Atomic bool exitFlag;
+    _Atomic int activePublishers;
+    _Atomic int activeSubscribers;
+    _Atomic int subscribersNumber;
+
+    CACHE_ALIGNED RingCursor cursors[MAX_SUBS];
+} RingBuffer;
+
+// Allocate with aligned_alloc(CACHE_LINE, sizeof(TQueue)), sections are kept on separate cache lines
+typedef struct {
+    // Read-mostly section, set at creation, changed only by setSizeI, destroyQueueI and subscription changes
+    QueueEngine engine;
+    QueueWaitStrategy waitStrategy;
+    int spinLimit;
+    _Atomic QueueOverflowPolicy overflowPolicy; // changed with mutex held, spinning publishers check it without
+    QueueReclaim reclaim;
+    int maxLag; // changed with mutex held, 0 - no limit
+    uint64_t maxLagNs;
+#ifdef PUBSUB_TRACING
+    bool tracing;
+#endif
+    _Atomic int msgMax; // atomic, spinning publishers check space without mutex
+    _Atomic bool exitFlag;
+    _Atomic uint32_t subscriptionsVersion; // changed by subscribe/unsubscribe, validates cached handles
+    int subscriberChunkCount;
+    RingBuffer *ring; // ring engine state (NULL for list engine)
+    _Atomic(SubscriberChunk *) subscriberChunks[SUB_CHUNKS_MAX]; // filled from start, read lock-free by handle
+
+    // Lock section, written by every locked operation
+    CACHE_ALIGNED pthread_mutex_t mutex;
+    pthread_cond_t msgGetCall;
+    pthread_cond_t msgPutCall;
     int exitMode; // 0 - no exit, 1 - publishers quit, 2 - subscribers quit
+    int subscribersNumber;
+
+    // Message node pool, free nodes are linked through Message::next
+    Message *freeNodes;
+    MessageChunk *chunks;
+    int poolSize;
+    void *freeBuffers[BUFFER_CLASSES]; // free payload buffers of copied messages, linked through first word
+    TPayload *releasedPayloads; // payloads whose last reference was dropped under mutex, released after unlock
+    TOverflowStats overflowStats;
+    uint64_t lagCheckNs; // next time subscribers are checked against maxLagNs
+    uint64_t notifyChunks[SUB_CHUNKS_MAX / 64]; // chunks with idle or waiting subscribers, visited by put
+#ifdef PUBSUB_LOCK_PROFILE
+    TLockSiteProfile lockProfile[LOCK_SITES];
+    QueueLockSite lockedSite; // site of thread holding mutex
+    uint64_t lockedNs; // since when it holds it
+#endif
+
+    // Producer section, written by put, polled by spinning subscribers
+    CACHE_ALIGNED Message *tail;
+    _Atomic uint64_t tailSeq; // sequence of next put message
     int activePublishers;
-    int activeSubscribers;
+    _Atomic int waitingPublishers; // publishers waiting on msgPutCall for free space, read by lock-free get
 
-    // Subscribers info
-    int subscribersNumber;
-    Subscriber subscribers[MAX_SUBS];
+    // Consumer section, written by get when messages are reclaimed, polled by spinning publishers
+    CACHE_ALIGNED Message *head;
+    _Atomic int msgNumber; // including messages reserved by reservePutI
+    int removedNodes; // tombstones still linked, unlinked once there are more than msgMax
+    int activeSubscribers;
+    uint64_t minCursor; // RECLAIM_MIN_CURSOR, lowest sequence of next message among subscribers
+                        // RECLAIM_HAZARD, messages before it were read by all and gave their space back
+    int minCursorCount; // number of subscribers on it, 0 only without subscribers
+    _Atomic int reclaimingReaders; // RECLAIM_HAZARD lock-free gets taking mutex to free space, destroy waits for them
 
-    // Queue base structure
-    Message *tail;
-    Message *head;
+    // Statistics, every thread counts into its own slot
+    CACHE_ALIGNED TQueueThreadStats stats[STATS_SLOTS];
 } TQueue;
+
+#define TOPIC_NAME_SIZE 40 // max topic name length including terminating zero
+#define BROKER_SHARDS 16 // number of creation locks, topics are spread by name hash
+
+// Entry of broker hash table, exactly one cache line
+// Filled once under shard lock and never moved, readers find topic without any lock
+typedef struct {
+    _Atomic uint64_t hash;   // name hash, 0 - free entry
+    _Atomic(TQueue *) queue; // published last, NULL while topic is being created
+    char name[TOPIC_NAME_SIZE];
+    char padding[CACHE_LINE - 2 * sizeof(uint64_t) - TOPIC_NAME_SIZE];
+} TTopic;
+
+// Creation lock of topics whose hash falls into the shard, kept on its own cache line
+typedef struct {
+    CACHE_ALIGNED pthread_mutex_t mutex;
+} BrokerShard;
+
+// Allocate with aligned_alloc(CACHE_LINE, sizeof(TBroker))
+typedef struct {
+    TTopic *topics; // open addressing with linear probing, at most half full
+    uint64_t mask;
+    int maxTopics;
+    _Atomic int topicNumber;
+
+    // Queues of new topics
+    int topicSize;
+    TQueueConfig config;
+
+    BrokerShard shards[BROKER_SHARDS];
+} TBroker;